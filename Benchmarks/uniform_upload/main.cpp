@@ -0,0 +1,173 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "src/shader.h"
+#include "src/gl_ext.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Microbenchmark of the per-frame uniform upload of Partie2-Lightning/Multiple_lights:
+// the string setters as they used to be (std::string + glGetUniformLocation on every call)
+// against the pre-hashed setters reading the location table built at link time.
+// Run from this directory so the relative shader paths resolve.
+
+const int ITERATIONS = 20000;
+const int UPLOADS_PER_ITERATION = 47;
+
+// the setters as they were before the location cache
+void legacySetVec3(const Shader &shader, const std::string &name, const float *value)
+{
+    glUniform3fv(glGetUniformLocation(shader.ID, name.c_str()), 1, value);
+}
+void legacySetFloat(const Shader &shader, const std::string &name, float value)
+{
+    glUniform1f(glGetUniformLocation(shader.ID, name.c_str()), value);
+}
+void legacySetMat4f(const Shader &shader, const std::string &name, const float *value)
+{
+    glUniformMatrix4fv(glGetUniformLocation(shader.ID, name.c_str()), 1, GL_FALSE, value);
+}
+
+void uploadLegacy(const Shader &shader, const float *v, const float *m)
+{
+    legacySetVec3(shader, "cameraPos", v);
+    legacySetFloat(shader, "material.shininess", 128.0f);
+    legacySetVec3(shader, "dirLight.direction", v);
+    legacySetVec3(shader, "dirLight.ambient", v);
+    legacySetVec3(shader, "dirLight.diffuse", v);
+    legacySetVec3(shader, "dirLight.specular", v);
+    for (int i = 0; i < 4; i++)
+    {
+        std::string light = "pointLights[" + std::to_string(i) + "]";
+        legacySetVec3(shader, light + ".position", v);
+        legacySetVec3(shader, light + ".ambient", v);
+        legacySetVec3(shader, light + ".diffuse", v);
+        legacySetVec3(shader, light + ".specular", v);
+        legacySetFloat(shader, light + ".quadratic", 1.0f);
+        legacySetFloat(shader, light + ".linear", 0.045f);
+        legacySetFloat(shader, light + ".constant", 0.0075f);
+    }
+    legacySetVec3(shader, "spotLight.position", v);
+    legacySetVec3(shader, "spotLight.direction", v);
+    legacySetVec3(shader, "spotLight.ambient", v);
+    legacySetVec3(shader, "spotLight.diffuse", v);
+    legacySetVec3(shader, "spotLight.specular", v);
+    legacySetFloat(shader, "spotLight.constant", 1.0f);
+    legacySetFloat(shader, "spotLight.linear", 0.045f);
+    legacySetFloat(shader, "spotLight.quadratic", 0.0075f);
+    legacySetFloat(shader, "spotLight.cutoff", 0.97f);
+    legacySetFloat(shader, "spotLight.cutoff_big", 0.96f);
+    legacySetFloat(shader, "spotLight.flash", 1.0f);
+    legacySetMat4f(shader, "model", m);
+    legacySetMat4f(shader, "view", m);
+}
+
+void uploadHashed(const Shader &shader, const float *v, const float *m)
+{
+    static const UniformId position[] = {"pointLights[0].position"_uniform, "pointLights[1].position"_uniform, "pointLights[2].position"_uniform, "pointLights[3].position"_uniform};
+    static const UniformId ambient[]  = {"pointLights[0].ambient"_uniform, "pointLights[1].ambient"_uniform, "pointLights[2].ambient"_uniform, "pointLights[3].ambient"_uniform};
+    static const UniformId diffuse[]  = {"pointLights[0].diffuse"_uniform, "pointLights[1].diffuse"_uniform, "pointLights[2].diffuse"_uniform, "pointLights[3].diffuse"_uniform};
+    static const UniformId specular[] = {"pointLights[0].specular"_uniform, "pointLights[1].specular"_uniform, "pointLights[2].specular"_uniform, "pointLights[3].specular"_uniform};
+    static const UniformId quadratic[] = {"pointLights[0].quadratic"_uniform, "pointLights[1].quadratic"_uniform, "pointLights[2].quadratic"_uniform, "pointLights[3].quadratic"_uniform};
+    static const UniformId linear[]   = {"pointLights[0].linear"_uniform, "pointLights[1].linear"_uniform, "pointLights[2].linear"_uniform, "pointLights[3].linear"_uniform};
+    static const UniformId constant[] = {"pointLights[0].constant"_uniform, "pointLights[1].constant"_uniform, "pointLights[2].constant"_uniform, "pointLights[3].constant"_uniform};
+
+    shader.setVec3("cameraPos"_uniform, v);
+    shader.setFloat("material.shininess"_uniform, 128.0f);
+    shader.setVec3("dirLight.direction"_uniform, v);
+    shader.setVec3("dirLight.ambient"_uniform, v);
+    shader.setVec3("dirLight.diffuse"_uniform, v);
+    shader.setVec3("dirLight.specular"_uniform, v);
+    for (int i = 0; i < 4; i++)
+    {
+        shader.setVec3(position[i], v);
+        shader.setVec3(ambient[i], v);
+        shader.setVec3(diffuse[i], v);
+        shader.setVec3(specular[i], v);
+        shader.setFloat(quadratic[i], 1.0f);
+        shader.setFloat(linear[i], 0.045f);
+        shader.setFloat(constant[i], 0.0075f);
+    }
+    shader.setVec3("spotLight.position"_uniform, v);
+    shader.setVec3("spotLight.direction"_uniform, v);
+    shader.setVec3("spotLight.ambient"_uniform, v);
+    shader.setVec3("spotLight.diffuse"_uniform, v);
+    shader.setVec3("spotLight.specular"_uniform, v);
+    shader.setFloat("spotLight.constant"_uniform, 1.0f);
+    shader.setFloat("spotLight.linear"_uniform, 0.045f);
+    shader.setFloat("spotLight.quadratic"_uniform, 0.0075f);
+    shader.setFloat("spotLight.cutoff"_uniform, 0.97f);
+    shader.setFloat("spotLight.cutoff_big"_uniform, 0.96f);
+    shader.setFloat("spotLight.flash"_uniform, 1.0f);
+    shader.setMat4f("model"_uniform, m);
+    shader.setMat4f("view"_uniform, m);
+}
+
+template <typename Upload>
+double nanosecondsPerUpload(const Shader &shader, Upload upload)
+{
+    glm::vec3 v(0.5f);
+    glm::mat4 m(1.0f);
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        upload(shader, glm::value_ptr(v), glm::value_ptr(m));
+    glFinish();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / (double(ITERATIONS) * UPLOADS_PER_ITERATION);
+}
+
+int main()
+{
+    // glfw: initialize and configure an invisible window, we only need its context
+    // ------------------------------------------------------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    GLFWwindow* window = glfwCreateWindow(64, 64, "uniform_upload", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+    {
+        Shader shader("../../Partie2-Lightning/Multiple_lights/shaders/shader.vs", "../../Partie2-Lightning/Multiple_lights/shaders/shader.fs");
+        shader.use();
+
+        // warm up both paths once so first-call driver work isn't measured
+        nanosecondsPerUpload(shader, uploadLegacy);
+        nanosecondsPerUpload(shader, uploadHashed);
+
+        double legacy = nanosecondsPerUpload(shader, uploadLegacy);
+        double hashed = nanosecondsPerUpload(shader, uploadHashed);
+        std::cout << "string + glGetUniformLocation: " << legacy << " ns/upload" << std::endl;
+        std::cout << "pre-hashed location table:     " << hashed << " ns/upload" << std::endl;
+        std::cout << "speedup: " << legacy / hashed << "x" << std::endl;
+    }
+
+    glfwTerminate();
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
 #include "src/camera.h"
 
 #include <iostream>
@@ -68,6 +69,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
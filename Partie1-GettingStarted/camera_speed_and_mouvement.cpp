@@ -7,6 +7,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
 
 #include <iostream>
 
@@ -55,6 +56,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // build and compile our shader zprogram
     // ------------------------------------
@@ -3,6 +3,7 @@
 #include <stb/stb_image.h>
 
 #include "shader.h"
+#include "gl_ext.h"
 
 #include <iostream>
 #include <cmath>
@@ -47,6 +48,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // build and compile our shader zprogram
     // ------------------------------------
@@ -8,6 +8,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "gl_ext.h"
 
 #include <iostream>
 #include <cmath>
@@ -52,6 +53,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // build and compile our shader zprogram
     // ------------------------------------
@@ -7,7 +7,9 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
 #include "src/camera.h"
+#include "src/texture_registry.h"
 
 #include <iostream>
 
@@ -69,6 +71,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
@@ -239,6 +242,7 @@ int main()
             model = glm::mat4(1.0f);
             model = glm::translate(model,cube_position[i]);
             cubeShader.setMat4f("model",glm::value_ptr(model));
+            cubeShader.setMat3("normalMatrix",glm::value_ptr(normalMatrix(model)));
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
         
@@ -328,37 +332,5 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(char const * filename)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename);
 }
\ No newline at end of file
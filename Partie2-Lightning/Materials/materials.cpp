@@ -7,6 +7,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
 #include "src/camera.h"
 
 #include <iostream>
@@ -68,6 +69,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
@@ -179,6 +181,7 @@ int main()
 
         //model = glm::rotate(model,(float)glfwGetTime(),glm::vec3(0.5f,0.5f,0.5f));
         cubeShader.setMat4f("model",glm::value_ptr(model));
+        cubeShader.setMat3("normalMatrix",glm::value_ptr(normalMatrix(model)));
         cubeShader.setMat4f("view",glm::value_ptr(view));
         cubeShader.setMat4f("projection",glm::value_ptr(projection));
 
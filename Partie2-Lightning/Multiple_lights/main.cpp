@@ -7,7 +7,9 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
 #include "src/camera.h"
+#include "src/texture_registry.h"
 
 #include <iostream>
 
@@ -72,13 +74,15 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
 
     // build and compile our shader zprogram
     // ------------------------------------
-    Shader cubeShader("shaders/shader.vs", "shaders/shader.fs");
+    // the fragment shader's light loop is specialized for our light count
+    Shader cubeShader("shaders/shader.vs", "shaders/shader.fs", ShaderDefines{{"NR_POINT_LIGHTS", std::to_string(NR_POINT_LIGHTS)}});
     Shader lightCubeShader("shaders/light_cube_shader.vs", "shaders/light_cube_shader.fs");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
@@ -174,8 +178,8 @@ int main()
     unsigned int specularMap = loadTexture("ressources/texture/container2_specular.png");
 
     cubeShader.use();
-    cubeShader.setInt("material.diffuse",0);
-    cubeShader.setInt("material.specular",1);
+    cubeShader.setInt("material.diffuse"_uniform,0);
+    cubeShader.setInt("material.specular"_uniform,1);
     
     int index = 0;
 
@@ -229,74 +233,74 @@ int main()
         cubeShader.use();
 
         // common var
-        cubeShader.setVec3("cameraPos",glm::value_ptr(camera.Position));
+        cubeShader.setVec3("cameraPos"_uniform,glm::value_ptr(camera.Position));
 
         // material properties
-        cubeShader.setFloat("material.shininess", 128.0f);
+        cubeShader.setFloat("material.shininess"_uniform, 128.0f);
 
         // dirLight parameters
-        cubeShader.setVec3("dirLight.direction", glm::value_ptr(dirLightDir));
-        cubeShader.setVec3("dirLight.ambient", glm::value_ptr(dirLghtAmbient));
-        cubeShader.setVec3("dirLight.diffuse", glm::value_ptr(dirLghtDiffuse));
-        cubeShader.setVec3("dirLight.specular", glm::value_ptr(dirLghtSpecular));
+        cubeShader.setVec3("dirLight.direction"_uniform, glm::value_ptr(dirLightDir));
+        cubeShader.setVec3("dirLight.ambient"_uniform, glm::value_ptr(dirLghtAmbient));
+        cubeShader.setVec3("dirLight.diffuse"_uniform, glm::value_ptr(dirLghtDiffuse));
+        cubeShader.setVec3("dirLight.specular"_uniform, glm::value_ptr(dirLghtSpecular));
 
         // Points lights
-        cubeShader.setVec3("pointLights[0].position", glm::value_ptr(lightPointPos[0]));
-        cubeShader.setVec3("pointLights[0].ambient", glm::value_ptr(lightAmbient));
-        cubeShader.setVec3("pointLights[0].diffuse", glm::value_ptr(lightDiffuse));
-        cubeShader.setVec3("pointLights[0].specular", glm::value_ptr(lightPointColor[0]));
-        cubeShader.setFloat("pointLights[0].quadratic", 1.0f);
-        cubeShader.setFloat("pointLights[0].linear", 0.045f);
-        cubeShader.setFloat("pointLights[0].constant", 0.0075f);
-
-        cubeShader.setVec3("pointLights[1].position", glm::value_ptr(lightPointPos[1]));
-        cubeShader.setVec3("pointLights[1].ambient", glm::value_ptr(lightAmbient));
-        cubeShader.setVec3("pointLights[1].diffuse", glm::value_ptr(lightDiffuse));
-        cubeShader.setVec3("pointLights[1].specular", glm::value_ptr(lightPointColor[1]));
-        cubeShader.setFloat("pointLights[1].quadratic", 1.0f);
-        cubeShader.setFloat("pointLights[1].linear", 0.045f);
-        cubeShader.setFloat("pointLights[1].constant", 0.0075f);
-
-        cubeShader.setVec3("pointLights[2].position", glm::value_ptr(lightPointPos[2]));
-        cubeShader.setVec3("pointLights[2].ambient", glm::value_ptr(lightAmbient));
-        cubeShader.setVec3("pointLights[2].diffuse", glm::value_ptr(lightDiffuse));
-        cubeShader.setVec3("pointLights[2].specular", glm::value_ptr(lightPointColor[2]));
-        cubeShader.setFloat("pointLights[2].quadratic", 1.0f);
-        cubeShader.setFloat("pointLights[2].linear", 0.045f);
-        cubeShader.setFloat("pointLights[2].constant", 0.0075f);
-
-        cubeShader.setVec3("pointLights[3].position", glm::value_ptr(lightPointPos[3]));
-        cubeShader.setVec3("pointLights[3].ambient", glm::value_ptr(lightAmbient));
-        cubeShader.setVec3("pointLights[3].diffuse", glm::value_ptr(lightDiffuse));
-        cubeShader.setVec3("pointLights[3].specular", glm::value_ptr(lightPointColor[3]));
-        cubeShader.setFloat("pointLights[3].quadratic", 1.0f);
-        cubeShader.setFloat("pointLights[3].linear", 0.045f);
-        cubeShader.setFloat("pointLights[3].constant", 0.0075f);
+        cubeShader.setVec3("pointLights[0].position"_uniform, glm::value_ptr(lightPointPos[0]));
+        cubeShader.setVec3("pointLights[0].ambient"_uniform, glm::value_ptr(lightAmbient));
+        cubeShader.setVec3("pointLights[0].diffuse"_uniform, glm::value_ptr(lightDiffuse));
+        cubeShader.setVec3("pointLights[0].specular"_uniform, glm::value_ptr(lightPointColor[0]));
+        cubeShader.setFloat("pointLights[0].quadratic"_uniform, 1.0f);
+        cubeShader.setFloat("pointLights[0].linear"_uniform, 0.045f);
+        cubeShader.setFloat("pointLights[0].constant"_uniform, 0.0075f);
+
+        cubeShader.setVec3("pointLights[1].position"_uniform, glm::value_ptr(lightPointPos[1]));
+        cubeShader.setVec3("pointLights[1].ambient"_uniform, glm::value_ptr(lightAmbient));
+        cubeShader.setVec3("pointLights[1].diffuse"_uniform, glm::value_ptr(lightDiffuse));
+        cubeShader.setVec3("pointLights[1].specular"_uniform, glm::value_ptr(lightPointColor[1]));
+        cubeShader.setFloat("pointLights[1].quadratic"_uniform, 1.0f);
+        cubeShader.setFloat("pointLights[1].linear"_uniform, 0.045f);
+        cubeShader.setFloat("pointLights[1].constant"_uniform, 0.0075f);
+
+        cubeShader.setVec3("pointLights[2].position"_uniform, glm::value_ptr(lightPointPos[2]));
+        cubeShader.setVec3("pointLights[2].ambient"_uniform, glm::value_ptr(lightAmbient));
+        cubeShader.setVec3("pointLights[2].diffuse"_uniform, glm::value_ptr(lightDiffuse));
+        cubeShader.setVec3("pointLights[2].specular"_uniform, glm::value_ptr(lightPointColor[2]));
+        cubeShader.setFloat("pointLights[2].quadratic"_uniform, 1.0f);
+        cubeShader.setFloat("pointLights[2].linear"_uniform, 0.045f);
+        cubeShader.setFloat("pointLights[2].constant"_uniform, 0.0075f);
+
+        cubeShader.setVec3("pointLights[3].position"_uniform, glm::value_ptr(lightPointPos[3]));
+        cubeShader.setVec3("pointLights[3].ambient"_uniform, glm::value_ptr(lightAmbient));
+        cubeShader.setVec3("pointLights[3].diffuse"_uniform, glm::value_ptr(lightDiffuse));
+        cubeShader.setVec3("pointLights[3].specular"_uniform, glm::value_ptr(lightPointColor[3]));
+        cubeShader.setFloat("pointLights[3].quadratic"_uniform, 1.0f);
+        cubeShader.setFloat("pointLights[3].linear"_uniform, 0.045f);
+        cubeShader.setFloat("pointLights[3].constant"_uniform, 0.0075f);
 
         // Spot lights
-        cubeShader.setVec3("spotLight.position", glm::value_ptr(camera.Position));
-        cubeShader.setVec3("spotLight.direction", glm::value_ptr(camera.Front));
-        cubeShader.setVec3("spotLight.ambient", glm::value_ptr(spotLightAmbient));
-        cubeShader.setVec3("spotLight.diffuse", glm::value_ptr(spotLightDiffuse));
-        cubeShader.setVec3("spotLight.specular", glm::value_ptr(spotLightSpecular));
-        cubeShader.setFloat("spotLight.constant", 1.0f);
-        cubeShader.setFloat("spotLight.linear", 0.045f);
-        cubeShader.setFloat("spotLight.quadratic", 0.0075f);
-        cubeShader.setFloat("spotLight.cutoff", glm::cos(glm::radians(12.5f)));
-        cubeShader.setFloat("spotLight.cutoff_big", glm::cos(glm::radians(15.0f)));  
+        cubeShader.setVec3("spotLight.position"_uniform, glm::value_ptr(camera.Position));
+        cubeShader.setVec3("spotLight.direction"_uniform, glm::value_ptr(camera.Front));
+        cubeShader.setVec3("spotLight.ambient"_uniform, glm::value_ptr(spotLightAmbient));
+        cubeShader.setVec3("spotLight.diffuse"_uniform, glm::value_ptr(spotLightDiffuse));
+        cubeShader.setVec3("spotLight.specular"_uniform, glm::value_ptr(spotLightSpecular));
+        cubeShader.setFloat("spotLight.constant"_uniform, 1.0f);
+        cubeShader.setFloat("spotLight.linear"_uniform, 0.045f);
+        cubeShader.setFloat("spotLight.quadratic"_uniform, 0.0075f);
+        cubeShader.setFloat("spotLight.cutoff"_uniform, glm::cos(glm::radians(12.5f)));
+        cubeShader.setFloat("spotLight.cutoff_big"_uniform, glm::cos(glm::radians(15.0f)));  
 
         // light properties
         if (index < 100){
-            cubeShader.setFloat("spotLight.flash",0.0f);
+            cubeShader.setFloat("spotLight.flash"_uniform,0.0f);
         } else {
-            cubeShader.setFloat("spotLight.flash",1.0f);
+            cubeShader.setFloat("spotLight.flash"_uniform,1.0f);
         }
 
         // view projection transformation
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 projection = camera.GetProjectionMatrix((float(SCR_WIDTH)/float(SCR_HEIGHT)));
-        cubeShader.setMat4f("view",glm::value_ptr(view));
-        cubeShader.setMat4f("projection",glm::value_ptr(projection));
+        cubeShader.setMat4f("view"_uniform,glm::value_ptr(view));
+        cubeShader.setMat4f("projection"_uniform,glm::value_ptr(projection));
 
         // world transformation
         glm::mat4 model = glm::mat4(1.0f);
@@ -316,15 +320,16 @@ int main()
             model = glm::mat4(1.0f);
             model = glm::translate(model,cube_position[i]);
             model = glm::rotate(model,(float)glfwGetTime(),glm::vec3(0.5f,0.5f,0.5f));
-            cubeShader.setMat4f("model",glm::value_ptr(model));
+            cubeShader.setMat4f("model"_uniform,glm::value_ptr(model));
+            cubeShader.setMat3("normalMatrix"_uniform,glm::value_ptr(normalMatrix(model)));
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
         
         // also draw lamps object
         // ----------------- 
         lightCubeShader.use();
-        lightCubeShader.setMat4f("projection", glm::value_ptr(projection));
-        lightCubeShader.setMat4f("view", glm::value_ptr(view));
+        lightCubeShader.setMat4f("projection"_uniform, glm::value_ptr(projection));
+        lightCubeShader.setMat4f("view"_uniform, glm::value_ptr(view));
 
 
         model = glm::mat4(1.0f);
@@ -335,8 +340,8 @@ int main()
             model = glm::mat4(1.0f);
             model = glm::translate(model, lightPointPos[i]);
             model = glm::scale(model,glm::vec3(0.1f,0.1f,0.3f));
-            lightCubeShader.setMat4f("model", glm::value_ptr(model));
-            lightCubeShader.setVec3("color", glm::value_ptr(lightPointColor[i]));
+            lightCubeShader.setMat4f("model"_uniform, glm::value_ptr(model));
+            lightCubeShader.setVec3("color"_uniform, glm::value_ptr(lightPointColor[i]));
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
 
@@ -344,7 +349,7 @@ int main()
         // model = glm::mat4(1.0f);
         // model = glm::translate(model, lightSpotPos);
         // model = glm::scale(model,glm::vec3(0.2f,0.2f,0.2f));
-        // lightCubeShader.setMat4f("model", glm::value_ptr(model));
+        // lightCubeShader.setMat4f("model"_uniform, glm::value_ptr(model));
         // glDrawArrays(GL_TRIANGLES, 0, 36);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -425,37 +430,5 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(char const * filename)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename);
 }
\ No newline at end of file
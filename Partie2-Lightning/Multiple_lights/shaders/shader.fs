@@ -55,7 +55,10 @@ in vec2 TexCoords;
   
 uniform vec3 cameraPos;
 
+// light count, can be specialized by the application through a shader define
+#ifndef NR_POINT_LIGHTS
 #define NR_POINT_LIGHTS 4
+#endif
 
 uniform Material material;
 uniform DirLight dirLight;
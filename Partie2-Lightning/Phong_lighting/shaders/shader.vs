@@ -6,12 +6,13 @@ out vec3 Normal;
 out vec3 FragPos;
 
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of model, from the CPU
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
-	Normal = mat3(transpose(inverse(model))) * aNormal;
+	Normal = normalMatrix * aNormal;
 	FragPos = vec3(model * vec4(aPos, 1.0));
 }
\ No newline at end of file
@@ -7,8 +7,10 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
 #include "src/camera.h"
 #include "src/model.h"
+#include "src/texture_registry.h"
 
 #include <iostream>
 
@@ -73,13 +75,14 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
 
     // build and compile our shader program
     // ------------------------------------
-    Shader shader("../shaders/shader.vs", "../shaders/shader.gs", "../shaders/shader.fs");
+    ShaderVariants shaderVariants("../shaders/shader.vs", "../shaders/shader.gs", "../shaders/shader.fs");
     Shader shaderNormal("../shaders/shaderNormal.vs", "../shaders/shaderNormal.gs", "../shaders/shaderNormal.fs");
 
     // // Uniform Buffer
@@ -104,6 +107,10 @@ int main()
     // glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 2 * sizeof(glm::mat4));
 
     Model ourModel("../ressources/models/backpack/backpack.obj");
+    // the backpack's material textures repacked into texture arrays, sampled by the MATERIAL_TEXTURE_ARRAYS variant
+    // of the shader; the plain variant and the 2D textures if they can't be built
+    bool textureArrays = ourModel.buildTextureArrays();
+    Shader &shader = shaderVariants.get(textureArrays ? ShaderDefines{{"MATERIAL_TEXTURE_ARRAYS", "1"}} : ShaderDefines());
 
     // render loop
     // -----------
@@ -155,6 +162,7 @@ int main()
         shaderNormal.setMat4f("projection", glm::value_ptr(projection));
         shaderNormal.setMat4f("view", glm::value_ptr(view));
         shaderNormal.setMat4f("model", glm::value_ptr(model));
+        shaderNormal.setMat3("normalMatrix", glm::value_ptr(normalMatrix(view * model)));
         ourModel.Draw(shaderNormal);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -226,37 +234,5 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(const char* filename,GLint mode)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename, false, mode);
 }
\ No newline at end of file
@@ -3,9 +3,19 @@
 out vec4 FragColor;
 in vec2 TexCoords;
 
+// defined by the application when the model's textures were repacked into texture arrays (see src/texture_array.h)
+#ifdef MATERIAL_TEXTURE_ARRAYS
+uniform sampler2DArray texture_diffuse_array;
+uniform ivec4 materialLayers; // diffuse, specular, normal, height layer of the mesh drawn, -1 if it has none
+#else
 uniform sampler2D textureb;
+#endif
 
 void main()
 {
+#ifdef MATERIAL_TEXTURE_ARRAYS
+    FragColor = materialLayers.x >= 0 ? texture(texture_diffuse_array, vec3(TexCoords, materialLayers.x)) : vec4(0.5, 0.5, 0.5, 1.0);
+#else
     FragColor = texture(textureb,TexCoords);
+#endif
 }
\ No newline at end of file
@@ -8,10 +8,10 @@ out VS_OUT {
 
 uniform mat4 view;
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of view * model, from the CPU
 
 void main()
 {
     gl_Position = view * model * vec4(aPos,1.0);
-    mat3 normalMatrix = mat3(transpose(inverse(view*model)));
     vs_out.normal = normalize(vec3(vec4(normalMatrix * aNormal,0.0)));
 }
@@ -7,8 +7,11 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
+#include "src/gpu_resource.h"
 #include "src/camera.h"
 #include "src/model.h"
+#include "src/texture_registry.h"
 
 #include <iostream>
 
@@ -73,6 +76,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
@@ -150,11 +154,10 @@ int main()
     };
 
     // cube VAO
-    unsigned int cubeVAO, cubeVBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    GpuVertexArray cubeVAO = GpuVertexArray::create();
+    GpuBuffer cubeVBO = GpuBuffer::create(sizeof(cubeVertices));
+    glBindVertexArray(cubeVAO.id());
+    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO.id());
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -163,11 +166,10 @@ int main()
     glBindVertexArray(0);
 
     // plane VAO
-    unsigned int planeVAO, planeVBO;
-    glGenVertexArrays(1, &planeVAO);
-    glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
+    GpuVertexArray planeVAO = GpuVertexArray::create();
+    GpuBuffer planeVBO = GpuBuffer::create(sizeof(planeVertices));
+    glBindVertexArray(planeVAO.id());
+    glBindBuffer(GL_ARRAY_BUFFER, planeVBO.id());
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -176,11 +178,10 @@ int main()
     glBindVertexArray(0);
 
     // Screen Quad VAO
-    unsigned int quadVAO, quadVBO;
-    glGenVertexArrays(1, &quadVAO);
-    glGenBuffers(1, &quadVBO);
-    glBindVertexArray(quadVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    GpuVertexArray quadVAO = GpuVertexArray::create();
+    GpuBuffer quadVBO = GpuBuffer::create(sizeof(quadVertices));
+    glBindVertexArray(quadVAO.id());
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO.id());
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
@@ -202,23 +203,20 @@ int main()
 
     // framebuffer configuration
     // -------------------------
-    unsigned int framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    GpuFramebuffer framebuffer = GpuFramebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
     // create a color attachment texture
-    unsigned int textureColorbuffer;
-    glGenTextures(1, &textureColorbuffer);
-    glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
+    GpuTexture textureColorbuffer = GpuTexture::create(SCR_WIDTH * SCR_HEIGHT * 3);
+    glBindTexture(GL_TEXTURE_2D, textureColorbuffer.id());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorbuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorbuffer.id(), 0);
     // create a renderbuffer object for depth and stencil attachment (we won't be sampling these)
-    unsigned int rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    GpuRenderbuffer rbo = GpuRenderbuffer::create(SCR_WIDTH * SCR_HEIGHT * 4);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo.id());
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT); // use a single renderbuffer object for both a depth AND stencil buffer.
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo); // now actually attach it
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo.id()); // now actually attach it
                                                                                                   // now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
@@ -245,7 +243,7 @@ int main()
         // would, but with the view camera reversed.
         // bind to framebuffer and draw scene as we normally would to color texture 
         // ------------------------------------------------------------------------
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
         glEnable(GL_DEPTH_TEST); // enable depth testing (is disabled for rendering screen-space quad)
 
         // make sure we clear the framebuffer's content
@@ -268,7 +266,7 @@ int main()
         // ------------------- Draw Scene ----------------------
         // Draw cubes
 
-        glBindVertexArray(cubeVAO);
+        glBindVertexArray(cubeVAO.id());
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, cubeTexture);
         model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
@@ -277,7 +275,7 @@ int main()
         glBindVertexArray(0);
 
         // Draw floor 
-        glBindVertexArray(planeVAO);
+        glBindVertexArray(planeVAO.id());
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, floorTexture);
         shader.setMat4f("model", glm::value_ptr(glm::mat4(1.0f)));
@@ -298,7 +296,7 @@ int main()
         shader.setMat4f("view", glm::value_ptr(view));
 
         // cubes
-        glBindVertexArray(cubeVAO);
+        glBindVertexArray(cubeVAO.id());
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, cubeTexture);
         model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
@@ -306,7 +304,7 @@ int main()
         glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
         // floor
-        glBindVertexArray(planeVAO);
+        glBindVertexArray(planeVAO.id());
         glBindTexture(GL_TEXTURE_2D, floorTexture);
         shader.setMat4f("model",  glm::value_ptr(glm::mat4(1.0f)));
         glDrawArrays(GL_TRIANGLES, 0, 6);
@@ -317,22 +315,21 @@ int main()
         glDisable(GL_DEPTH_TEST); // disable depth test so screen-space quad isn't discarded due to depth test.
 
         screenShader.use();
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D, textureColorbuffer);	// use the color attachment texture as the texture of the quad plane
+        glBindVertexArray(quadVAO.id());
+        glBindTexture(GL_TEXTURE_2D, textureColorbuffer.id());	// use the color attachment texture as the texture of the quad plane
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        // GL objects destroyed up to here are deleted once the GPU has finished this frame
+        GpuResourcePool::instance().collect();
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
+    // de-allocate all resources while the context is still there, the handles above are stale afterwards
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &planeVAO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &planeVBO);
+    GpuResourcePool::instance().destroyAll();
 
     glfwTerminate();    
     return 0;
@@ -394,37 +391,5 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(const char* filename,GLint mode)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename, false, mode);
 }
\ No newline at end of file
@@ -7,8 +7,11 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
+#include "src/gpu_resource.h"
 #include "src/camera.h"
 #include "src/model.h"
+#include "src/texture_registry.h"
 
 #include <iostream>
 
@@ -41,6 +44,14 @@ const int NR_POINT_LIGHTS = 4;
 
 unsigned int planeVAO;
 
+// shadow quality tier, selected with the 1/2/3 keys; each tier is a specialized variant of the scene shader
+int shadowQuality = 2;
+const ShaderDefines SHADOW_QUALITY_DEFINES[3] = {
+    {{"SHADOW_SAMPLES", "1"}},
+    {{"SHADOW_SAMPLES", "8"}},
+    {{"SHADOW_SAMPLES", "20"}}
+};
+
 int main()
 {
     // glfw: initialize and configure
@@ -80,6 +91,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
@@ -93,7 +105,7 @@ int main()
     // build and compile our shader program
     // ------------------------------------
     Shader depth_map_shader("../shaders/depth_map_shader.vs", "../shaders/depth_map_shader.gs", "../shaders/depth_map_shader.fs");
-    Shader shader("../shaders/shader.vs", "../shaders/shader.fs");
+    ShaderVariants shaderVariants("../shaders/shader.vs", "../shaders/shader.fs");
     Shader light_shader("../shaders/light_shader.vs", "../shaders/light_shader.fs");
 
     // load textures
@@ -103,12 +115,10 @@ int main()
     // configure depth map FBO
     // -----------------------
     const unsigned int SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
+    GpuFramebuffer depthMapFBO = GpuFramebuffer::create();
     // create depth cubemap texture
-    unsigned int depthCubemap;
-    glGenTextures(1, &depthCubemap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+    GpuTexture depthCubemap = GpuTexture::create((size_t)SHADOW_WIDTH * SHADOW_HEIGHT * 4 * 6);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap.id());
     for (unsigned int i = 0; i < 6; ++i)
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -117,16 +127,12 @@ int main()
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO.id());
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap.id(), 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    shader.use();
-    shader.setInt("cubeMap",0);
-    shader.setInt("diffuseTexture",1);
-
     glm::mat4 lightProjection, lightView,lightSpaceMatrix,model,view,projection;
 
 
@@ -167,7 +173,7 @@ int main()
 
         // render scene from light's point of view
         glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO.id());
         glClear(GL_DEPTH_BUFFER_BIT);
         depth_map_shader.use();
         model = glm::mat4(1.0f);
@@ -189,7 +195,11 @@ int main()
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // pick this frame's variant, it's only compiled the first time its tier is selected
+        Shader &shader = shaderVariants.get(SHADOW_QUALITY_DEFINES[shadowQuality]);
         shader.use();
+        shader.setInt("cubeMap",0);
+        shader.setInt("diffuseTexture",1);
         view = camera.GetViewMatrix();
         projection = camera.GetProjectionMatrix((float)SCR_WIDTH/(float)SCR_HEIGHT);
         shader.setMat4f("view", glm::value_ptr(view));
@@ -199,7 +209,7 @@ int main()
         shader.setFloat("far_plane", far);
         shader.setVec3("viewPos",glm::value_ptr(camera.Position));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap.id());
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, floorTexture);
         renderScene(shader);
@@ -232,10 +242,13 @@ int main()
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        // GL objects destroyed up to here are deleted once the GPU has finished this frame
+        GpuResourcePool::instance().collect();
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
+    // de-allocate all resources while the context is still there, the handles above are stale afterwards
     // ------------------------------------------------------------------------
+    GpuResourcePool::instance().destroyAll();
     glfwTerminate();    
     return 0;
 }
@@ -246,6 +259,7 @@ void renderScene(const Shader &shader)
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::scale(model, glm::vec3(10.0f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     glDisable(GL_CULL_FACE); // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
     shader.setInt("reverse_normals", 1); // A small little hack to invert normals when drawing cube from the inside so lighting still works.
     renderCube();
@@ -256,33 +270,39 @@ void renderScene(const Shader &shader)
     model = glm::translate(model, glm::vec3(0.0f, 1.5f, 0.0));
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     // cubes
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(4.0f, -3.5f, 0.0));
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(2.0f, 3.0f, 1.0));
     model = glm::scale(model, glm::vec3(0.75f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(-3.0f, -1.0f, 0.0));
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(-1.5f, 1.0f, 1.5));
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(-1.5f, 2.0f, -3.0));
     model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
     model = glm::scale(model, glm::vec3(0.75f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
 }
 
@@ -409,6 +429,14 @@ void processInput(GLFWwindow *window)
         camera.Position -= glm::normalize(glm::cross(camera.Front, camera.Up)) * cameraSpeed;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.Position += glm::normalize(glm::cross(camera.Front, camera.Up)) * cameraSpeed;
+
+    // shadow quality tiers
+    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+        shadowQuality = 0;
+    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+        shadowQuality = 1;
+    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+        shadowQuality = 2;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -480,37 +508,5 @@ unsigned int loadCubemap(vector<std::string> faces)
 
 unsigned int loadTexture(const char* filename,GLint mode)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename, false, mode);
 }
\ No newline at end of file
@@ -15,8 +15,13 @@ uniform vec3 lightColor;
 
 uniform float far_plane;
 
+// number of shadow taps (at most 20), specialized per quality tier by the application
+#ifndef SHADOW_SAMPLES
+#define SHADOW_SAMPLES 20
+#endif
+
 // array of offset direction for sampling
-vec3 sampleOffsetDirections[20] = vec3[]
+const vec3 sampleOffsetDirections[20] = vec3[]
 (
    vec3(1, 1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1, 1,  1), 
    vec3(1, 1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
@@ -30,7 +35,7 @@ float ShadowCalculation(vec3 fragPos,float bias)
     vec3 fragToLight = fragPos - lightPos;
     float currentDepth = length(fragToLight);
     float shadow = 0.0;
-    int samples = 20;
+    const int samples = SHADOW_SAMPLES;
     float viewDistance = length(viewPos - fragPos);
     float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;;
     for(int i = 0; i < samples; ++i)
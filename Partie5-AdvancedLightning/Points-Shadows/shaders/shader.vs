@@ -11,6 +11,7 @@ out VS_OUT {
 
 uniform mat4 projection;
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of model, from the CPU
 uniform mat4 view;
 
 uniform bool reverse_normals;
@@ -18,9 +19,9 @@ uniform bool reverse_normals;
 void main() {
     vs_out.FragPos = vec3(model * vec4(aPos,1.0));
     if(reverse_normals) // a slight hack to make sure the outer large cube displays lighting from the 'inside' instead of the default 'outside'.
-        vs_out.Normal = transpose(inverse(mat3(model))) * (-1.0 * aNormal);
+        vs_out.Normal = normalMatrix * (-1.0 * aNormal);
     else
-        vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
+        vs_out.Normal = normalMatrix * aNormal;
     vs_out.TexCoords = aTexCoords;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -7,8 +7,11 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/gl_ext.h"
+#include "src/gpu_resource.h"
 #include "src/camera.h"
 #include "src/model.h"
+#include "src/texture_registry.h"
 
 #include <iostream>
 
@@ -41,6 +44,14 @@ const int NR_POINT_LIGHTS = 4;
 
 unsigned int planeVAO;
 
+// shadow quality tier, selected with the 1/2/3 keys; each tier is a specialized variant of the scene shader
+int shadowQuality = 1;
+const ShaderDefines SHADOW_QUALITY_DEFINES[3] = {
+    {{"PCF_RADIUS", "0"}},
+    {{"PCF_RADIUS", "1"}},
+    {{"PCF_RADIUS", "2"}}
+};
+
 int main()
 {
     // glfw: initialize and configure
@@ -80,6 +91,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
@@ -94,7 +106,7 @@ int main()
     // ------------------------------------
     Shader depth_map_shader("../shaders/depth_map_shader.vs", "../shaders/depth_map_shader.fs");
     Shader debug_shader("../shaders/debug_shader.vs", "../shaders/debug_shader.fs");
-    Shader shader("../shaders/shader.vs", "../shaders/shader.fs");
+    ShaderVariants shaderVariants("../shaders/shader.vs", "../shaders/shader.fs");
     Shader light_shader("../shaders/light_shader.vs", "../shaders/light_shader.fs");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
@@ -131,20 +143,18 @@ int main()
     // configure depth map FBO
     // -----------------------
     const unsigned int SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
+    GpuFramebuffer depthMapFBO = GpuFramebuffer::create();
     // create depth texture
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    GpuTexture depthMap = GpuTexture::create((size_t)SHADOW_WIDTH * SHADOW_HEIGHT * 4);
+    glBindTexture(GL_TEXTURE_2D, depthMap.id());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO.id());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap.id(), 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -152,10 +162,6 @@ int main()
     debug_shader.use();
     debug_shader.setInt("depthMap",0);
 
-    shader.use();
-    shader.setInt("depthMap",0);
-    shader.setInt("diffuseTexture",1);
-
     glm::mat4 lightProjection, lightView,lightSpaceMatrix,model,view,projection;
 
     // Render Loop
@@ -189,7 +195,7 @@ int main()
         depth_map_shader.setMat4f("lightSpaceMatrix", glm::value_ptr(lightSpaceMatrix));
 
         glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO.id());
         glClear(GL_DEPTH_BUFFER_BIT);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, floorTexture);
@@ -201,7 +207,11 @@ int main()
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // pick this frame's variant, it's only compiled the first time its tier is selected
+        Shader &shader = shaderVariants.get(SHADOW_QUALITY_DEFINES[shadowQuality]);
         shader.use();
+        shader.setInt("depthMap",0);
+        shader.setInt("diffuseTexture",1);
         camera.Position = glm::vec3(-20.0f,3.0f,0.0f);
         view = camera.GetViewMatrix();
         projection = camera.GetProjectionMatrix((float)SCR_WIDTH/(float)SCR_HEIGHT);
@@ -211,7 +221,7 @@ int main()
         shader.setVec3("lightPos",glm::value_ptr(lightPos));
         shader.setVec3("viewPos",glm::value_ptr(camera.Position));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
+        glBindTexture(GL_TEXTURE_2D, depthMap.id());
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, floorTexture);
         renderScene(shader);
@@ -243,10 +253,13 @@ int main()
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        // GL objects destroyed up to here are deleted once the GPU has finished this frame
+        GpuResourcePool::instance().collect();
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
+    // de-allocate all resources while the context is still there, the handles above are stale afterwards
     // ------------------------------------------------------------------------
+    GpuResourcePool::instance().destroyAll();
     glfwTerminate();    
     return 0;
 }
@@ -256,6 +269,7 @@ void renderScene(const Shader &shader)
     // floor
     glm::mat4 model = glm::mat4(1.0f);
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     glBindVertexArray(planeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     // cubes
@@ -263,17 +277,20 @@ void renderScene(const Shader &shader)
     model = glm::translate(model, glm::vec3(0.0f, 1.5f, 0.0));
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(2.0f, 1.0f, 1.0));
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 2.0));
     model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
     model = glm::scale(model, glm::vec3(0.25));
     shader.setMat4f("model", glm::value_ptr(model));
+    shader.setMat3("normalMatrix", glm::value_ptr(normalMatrix(model)));
     renderCube();
 }
 
@@ -400,6 +417,14 @@ void processInput(GLFWwindow *window)
         camera.Position -= glm::normalize(glm::cross(camera.Front, camera.Up)) * cameraSpeed;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.Position += glm::normalize(glm::cross(camera.Front, camera.Up)) * cameraSpeed;
+
+    // shadow quality tiers
+    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+        shadowQuality = 0;
+    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+        shadowQuality = 1;
+    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+        shadowQuality = 2;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -439,37 +464,5 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(const char* filename,GLint mode)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename, false, mode);
 }
\ No newline at end of file
@@ -13,6 +13,11 @@ uniform sampler2D shadowMap;
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+// PCF kernel radius in texels, (2 * PCF_RADIUS + 1)^2 taps; specialized per quality tier by the application
+#ifndef PCF_RADIUS
+#define PCF_RADIUS 1
+#endif
+
 float ShadowCalculation(vec4 fragPosLightSpace,float bias)
 {
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
@@ -23,16 +28,16 @@ float ShadowCalculation(vec4 fragPosLightSpace,float bias)
 
     float shadow = 0.0;
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    for(int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
     {
-        for(int y = -1; y <= 1; ++y)
+        for(int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
         {
             float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) *
             texelSize).r;
             shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
         }
     }
-    shadow /= 9.0;
+    shadow /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
 
     if(projCoords.z > 1.0)
         shadow = 0.0;
@@ -12,12 +12,13 @@ out VS_OUT {
 
 uniform mat4 projection;
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of model, from the CPU
 uniform mat4 view;
 uniform mat4 lightSpaceMatrix;
 
 void main() {
     vs_out.FragPos = vec3(model * vec4(aPos,1.0));
-    vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
+    vs_out.Normal = normalMatrix * aNormal;
     vs_out.TexCoords = aTexCoords;
     vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos,1.0);
     gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
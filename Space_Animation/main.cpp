@@ -7,16 +7,31 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "src/shader.h"
+#include "src/asteroid_field.h"
+#include "src/gl_ext.h"
+#include "src/gl_state.h"
 #include "src/camera.h"
+#include "src/frustum_culling.h"
+#include "src/gpu_culling.h"
+#include "src/gpu_resource.h"
+#include "src/impostor.h"
+#include "src/instance_format.h"
 #include "src/model.h"
+#include "src/process_memory.h"
+#include "src/render_queue.h"
+#include "src/texture_registry.h"
 
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char* filename,GLint mode = GL_REPEAT);
+void pointInstanceAttributes(Model &rock, unsigned int buffer, bool packed, size_t firstInstance = 0);
 
 // settings
 const unsigned int SCR_WIDTH = 1400;
@@ -36,8 +51,32 @@ float lastFrame = 0.0f;
 // Lights parameters 
 const int NR_POINT_LIGHTS = 4;
 
-int main()
+// asteroid levels of detail: share of the rock's triangles and error bound (relative to its size) of each level after
+// the full one, and the screen space error in pixels a level may show before a finer one is used
+const std::vector<LodLevel> ROCK_LODS = {{0.5f, 0.02f}, {0.25f, 0.05f}, {0.1f, 0.1f}};
+const float LOD_PIXEL_ERROR = 1.0f;
+// asteroids smaller than this on screen (in pixels) turn into impostors, crossfading over the next IMPOSTOR_FADE of
+// the distance
+const float IMPOSTOR_PIXELS = 24.0f;
+const float IMPOSTOR_FADE = 0.15f;
+// planet and rock vertices in the quantized formats, the shaders here decode them
+const bool QUANTIZE_VERTICES = true;
+
+// asteroid culling: keys 1/2/3 or the second command line argument (cpu/gpu/off)
+enum CullMode { CULL_CPU, CULL_GPU, CULL_OFF };
+const char* CULL_MODE_NAMES[3] = {"cpu", "gpu", "off"};
+CullMode cullMode = CULL_CPU;
+
+// usage: Space_Animation [asteroid count] [cpu|gpu|off] [32|16 bytes per instance] [seed]
+// defaults to 1M asteroids in 32 byte instances, culled on the CPU; a given seed always gives the same field
+int main(int argc, char **argv)
 {
+    for (int mode = 0; argc > 2 && mode < 3; mode++)
+        if (std::string(argv[2]) == CULL_MODE_NAMES[mode])
+            cullMode = (CullMode)mode;
+    bool packedInstances = argc > 3 && std::string(argv[3]) == "16";
+    size_t instanceSize = packedInstances ? sizeof(PackedInstance) : sizeof(CompactInstance);
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -73,92 +112,156 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // Configure all OpenGL states
     glEnable(GL_DEPTH_TEST);
 
+    // every bind and uniform of this demo goes through GLState, so it can drop the ones that change nothing
+    GLState &gl = GLState::instance();
+    gl.enabled = true;
+
     // build and compile our shader program
     // ------------------------------------
     Shader planet_shader("../shaders/planet_shader.vs", "../shaders/planet_shader.fs");
     Shader sun_shader("../shaders/sun_shader.vs", "../shaders/sun_shader.fs");
-    Shader asteroid_shader("../shaders/asteroid_shader.vs", "../shaders/asteroid_shader.fs");
-
-    Model planet("../ressources/models/Jupiter/13905_Jupiter_V1_l3.obj");
-    Model rock("../ressources/models/rock/rock.obj");
-
-    // generate a large list of semi-random model transformation matrices
-    // ------------------------------------------------------------------
+    ShaderDefines instanceDefines = {{"INSTANCE_BYTES", std::to_string(instanceSize)}};
+    Shader asteroid_shader("../shaders/asteroid_shader.vs", "../shaders/asteroid_shader.fs", instanceDefines);
+    std::vector<std::string> cullOutputs = {"culledRecord0"};
+    if (!packedInstances)
+        cullOutputs.push_back("culledRecord1");
+    Shader asteroid_cull_shader("../shaders/asteroid_cull.vs", "../shaders/asteroid_cull.gs", cullOutputs, instanceDefines);
+    Shader impostor_shader("../shaders/impostor.vs", "../shaders/impostor.fs", instanceDefines);
+    Shader impostor_bake_shader("../shaders/impostor_bake.vs", "../shaders/impostor_bake.fs");
+
+    // decode textures in the background and stream them in while the first frames are drawn with placeholders
+    TextureRegistry::instance().asyncLoading = true;
+
+    Model planet("../ressources/models/Jupiter/13905_Jupiter_V1_l3.obj", false, std::vector<LodLevel>(), WeldTolerance(), QUANTIZE_VERTICES);
+    // the rock's VAO gets the instance attributes pointed at it, so it lives in an arena of its own, sized to fit.
+    // asteroid_shader never reads tangents: without the tangent frame its normal map doesn't make the rock a Tangent
+    // mesh, locations 3 and up stay free for the instances and the vertices take 16 bytes (quantized) instead of 24
+    MeshArena rockArena;
+    rockArena.pageVertexBytes = rockArena.pageIndexBytes = 0;
+    Model rock("../ressources/models/rock/rock.obj", false, ROCK_LODS, WeldTolerance(), QUANTIZE_VERTICES, rockArena,
+               MeshRetention::DropAfterUpload, false);
+    TextureRegistry::instance().printStats();
+    MeshArena::shared().printStats();
+    // the models' CPU-side mesh data is dropped by now, the peak is what the import needed
+    ProcessMemory::print("models loaded");
+
+    // generate a large list of semi-random asteroid transformations
+    // --------------------------------------------------------------
    
     glm::vec3 sun_position(4000.0f,2000.0f,-10000.0f); 
    
-    unsigned int amount = 100000;
-    glm::mat4* modelMatrices;
-    modelMatrices = new glm::mat4[amount];
-    srand(static_cast<unsigned int>(glfwGetTime())); // initialize random seed
-    float radius = 2500.0;
-    float offset = 500.0f;
-    for (unsigned int i = 0; i < amount; i++)
+    unsigned int amount = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 1000000;
+
+    // bounding sphere of the rock in object space; an asteroid's sphere is it moved and scaled with the instance
+    glm::vec3 rockMin = rock.meshes[0].aabbMin, rockMax = rock.meshes[0].aabbMax;
+    for (const Mesh &mesh : rock.meshes)
     {
-        glm::mat4 model = glm::mat4(1.0f);
-        // 1. translation: displace along circle with 'radius' in range [-offset, offset]
-        float angle = (float)i / (float)amount * 360.0f;
-        float displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float x = sin(angle) * radius + displacement;
-        displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float y = displacement * 0.2f; // keep height of asteroid field smaller compared to width of x and z
-        displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float z = cos(angle) * radius + displacement;
-        model = glm::translate(model, glm::vec3(x, y, z));
-
-        // 2. scale: Scale between 0.025 and 0.125f
-        float scale = static_cast<float>((rand() % 100) / 400.0 + 0.05);
-        model = glm::scale(model, glm::vec3(scale));
-
-        // 3. rotation: add random rotation around a (semi)randomly picked rotation axis vector
-        float rotAngle = static_cast<float>((rand() % 360));
-        model = glm::rotate(model, rotAngle, glm::vec3(0.4f, 0.6f, 0.8f));
-
-        // 4. now add to list of matrices
-        modelMatrices[i] = model;
+        rockMin = glm::min(rockMin, mesh.aabbMin);
+        rockMax = glm::max(rockMax, mesh.aabbMax);
     }
+    glm::vec3 rockCenter = (rockMin + rockMax) * 0.5f;
+    float rockRadius = glm::length(rockMax - rockCenter);
+
+    // an asteroid switches to level i once level i's error, scaled with it, projects to less than LOD_PIXEL_ERROR;
+    // error and radius scale alike, so the switch distances are per unit of bounding radius
+    float pixelsPerUnit = SCR_HEIGHT * 0.5f / tan(glm::radians(45.0f) * 0.5f);
+    std::vector<float> lodDistances;
+    for (unsigned int lod = 1; lod < rock.lodCount(); lod++)
+    {
+        float distance = rock.lodError(lod) * pixelsPerUnit / (LOD_PIXEL_ERROR * rockRadius);
+        lodDistances.push_back(lodDistances.empty() ? distance : std::max(distance, lodDistances.back()));
+    }
+
+    // past the mesh levels come two more: the crossfade, drawn both as the coarsest mesh and as an impostor, and
+    // impostors alone. Their distances follow from the screen size of the bounding sphere's diameter.
+    float impostorStart = 2.0f * pixelsPerUnit / IMPOSTOR_PIXELS;
+    glm::vec2 impostorFade(impostorStart, impostorStart * (1.0f + IMPOSTOR_FADE));
+    std::vector<float> impostorLodDistances;
+    for (float distance : lodDistances)
+        impostorLodDistances.push_back(std::min(distance, impostorStart));
+    impostorLodDistances.push_back(impostorFade.x);
+    impostorLodDistances.push_back(impostorFade.y);
+    for (unsigned int lod = 0; lod < rock.lodCount(); lod++)
+        std::cout << "LOD:: rock level " << lod << ": " << rock.lodTriangles(lod) << " triangles, error " << rock.lodError(lod)
+                  << (lod > 0 ? ", from " + std::to_string(impostorLodDistances[lod - 1]) + " radii" : std::string()) << std::endl;
+    std::cout << "LOD:: impostors from " << impostorFade.x << " radii, fully at " << impostorFade.y << std::endl;
+    // baked once the rock's textures are resident, until then the meshes go all the way
+    ImpostorAtlas impostors(8, 128);
+    bool impostorsBaked = false;
+
+    // the same seed gives the same field, so runs can be compared
+    AsteroidField field;
+    if (argc > 4)
+        field.settings.seed = strtoull(argv[4], NULL, 10);
+    float radius = field.settings.radius;
+    double generateStart = glfwGetTime();
+    field.generate(amount, rockCenter, rockRadius);
+    std::cout << "ASTEROIDS:: generated " << amount << " asteroids (seed " << field.settings.seed << ") in "
+              << (glfwGetTime() - generateStart) * 1000.0 << " ms on " << ThreadPool::shared().size() << " thread(s)" << std::endl;
+    const std::vector<CompactInstance> &asteroids = field.instances;
+    const BoundingSpheres &asteroidBounds = field.bounds;
+    glm::vec3 fieldMin = field.boundsMin;
+    glm::vec3 fieldExtent = field.boundsMax - field.boundsMin;
+
+    // halve the instance data again by quantizing it
+    std::vector<PackedInstance> packedAsteroids;
+    if (packedInstances)
+    {
+        packedAsteroids.resize(amount);
+        for (unsigned int i = 0; i < amount; i++)
+            packedAsteroids[i] = PackedInstance::pack(asteroids[i], fieldMin, fieldExtent);
+    }
+    const void *instanceData = packedInstances ? (const void*)packedAsteroids.data() : (const void*)asteroids.data();
+    std::cout << "ASTEROIDS:: " << amount << " instances of " << instanceSize << " bytes, "
+              << amount * instanceSize / (1024 * 1024) << " MB" << std::endl;
 
     // configure instanced array
     // -------------------------
-    unsigned int buffer;
-    glGenBuffers(1, &buffer);
+    // every asteroid, drawn as is when culling is off and the input of the GPU culling pass
+    GpuBuffer instanceBuffer = GpuBuffer::create(amount * instanceSize);
+    unsigned int buffer = instanceBuffer.id();
     glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, amount * instanceSize, instanceData, GL_STATIC_DRAW);
 
-    // set transformation matrices as an instance vertex attribute (with divisor 1)
-    // note: we're cheating a little by taking the, now publicly declared, VAO of the model's mesh(es) and adding new vertexAttribPointers
-    // normally you'd want to do this in a more organized fashion, but for learning purposes this will do.
-    // -----------------------------------------------------------------------------------------------------------------------------------
-    for (unsigned int i = 0; i < rock.meshes.size(); i++)
+    // CPU culling: refilled every frame with the instances of the asteroids that survive frustum culling
+    FrustumCuller culler;
+    InstanceStream visibleInstances;
+
+    // GPU culling: the instances are read as points, one uvec4 per 16 bytes, and the survivors captured on the GPU
+    TransformFeedbackCuller gpuCuller(instanceSize, amount);
+    gl.bindVertexArray(gpuCuller.sourceVertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int word = 0; word < instanceSize / 16; word++)
     {
-        unsigned int VAO = rock.meshes[i].VAO;
-        glBindVertexArray(VAO);
-        // set attribute pointers for matrix (4 times vec4)
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-        glVertexAttribDivisor(3, 1);
-        glVertexAttribDivisor(4, 1);
-        glVertexAttribDivisor(5, 1);
-        glVertexAttribDivisor(6, 1);
-
-        glBindVertexArray(0);
+        glEnableVertexAttribArray(word);
+        glVertexAttribIPointer(word, 4, GL_UNSIGNED_INT, (GLsizei)instanceSize, (void*)((size_t)word * 16));
     }
+    gl.bindVertexArray(0);
+    // buffer the rock's instance attributes read from, changes with the culling mode
+    unsigned int instanceSource = 0, boundInstanceSource = 0;
+    std::cout << "CULLING:: GPU culling draws " << (gpuCuller.indirect ? "indirect with the count written by the GPU" : "the previous frame's survivors") << std::endl;
+
+    // draws of a frame are queued and issued sorted by program, material and VAO
+    RenderQueue queue;
+    queue.nearDistance = 1.0f;
+    queue.farDistance = 100000.0f;
 
     // Render Loop
     // -----------
+    bool firstFrame = true;
+    double lastCounterReport = glfwGetTime();
+    unsigned int framesSinceReport = 0;
+    gl.resetCounters();
     while(!glfwWindowShouldClose(window))
     {
+        // stream in the next slice of pending texture uploads
+        AsyncTextureLoader::instance().update();
+
         // per-frame time logic
         // --------------------
         float currentFrame = static_cast<float>(glfwGetTime());
@@ -169,6 +272,18 @@ int main()
         // -----
         processInput(window);
 
+        if (!impostorsBaked)
+        {
+            bool texturesReady = true;
+            for (const Texture &texture : rock.textures_loaded)
+                texturesReady = texturesReady && !AsyncTextureLoader::instance().isPending(texture.id);
+            if (texturesReady)
+            {
+                impostors.bake(rock, impostor_bake_shader, rockCenter, rockRadius);
+                impostorsBaked = true;
+            }
+        }
+
         // render
         // ------
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -183,58 +298,208 @@ int main()
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 1.0f, 100000.0f);
         glm::mat4 model = glm::mat4(1.0f);
 
+        // cull the asteroid field
+        double cullStart = glfwGetTime();
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        size_t visible = amount;
+        if (cullMode == CULL_CPU)
+        {
+            // on the worker threads, then stream the visible instances to the instance buffer grouped by level of detail
+            visible = culler.cull(frustum, asteroidBounds);
+            culler.selectLods(asteroidBounds, camera.Position, impostorsBaked ? impostorLodDistances : lodDistances);
+            void *visibleData = visibleInstances.map(visible * instanceSize);
+            if (visibleData && packedInstances)
+                culler.compact(packedAsteroids.data(), static_cast<PackedInstance*>(visibleData));
+            else if (visibleData)
+                culler.compact(asteroids.data(), static_cast<CompactInstance*>(visibleData));
+            visibleInstances.unmap();
+            instanceSource = visibleInstances.buffer;
+        }
+        else if (cullMode == CULL_GPU)
+        {
+            // a transform feedback pass, the CPU only sets the frustum
+            asteroid_cull_shader.use();
+            asteroid_cull_shader.setVec4("frustumPlanes"_uniform, glm::value_ptr(frustum.planes[0]), 6);
+            asteroid_cull_shader.setVec4("boundingSphere"_uniform, glm::value_ptr(glm::vec4(rockCenter, rockRadius)));
+            asteroid_cull_shader.setVec3("cameraPos"_uniform, glm::value_ptr(camera.Position));
+            asteroid_cull_shader.setFloat("maxDistance"_uniform, 0.0f);
+            asteroid_cull_shader.setVec3("fieldMin"_uniform, glm::value_ptr(fieldMin));
+            asteroid_cull_shader.setVec3("fieldExtent"_uniform, glm::value_ptr(fieldExtent));
+            gpuCuller.cull(asteroid_cull_shader, amount);
+            instanceSource = gpuCuller.instanceBuffer();
+            visible = gpuCuller.visibleCount;
+        }
+        else
+            instanceSource = buffer;
+        // the CPU path points the attributes at each level's range when drawing
+        if (cullMode != CULL_CPU && instanceSource != boundInstanceSource)
+        {
+            pointInstanceAttributes(rock, instanceSource, packedInstances);
+            boundInstanceSource = instanceSource;
+        }
+        double cullMs = (glfwGetTime() - cullStart) * 1000.0;
+
+        queue.setViewer(camera.Position);
+
         // Draw Sun
         sun_shader.use();
         model = glm::mat4(1.0f);
         model = glm::translate(model,sun_position);
         model = glm::scale(model,glm::vec3(0.5f));
-        sun_shader.setMat4f("model", glm::value_ptr(model));
-        sun_shader.setMat4f("view", glm::value_ptr(view));
-        sun_shader.setMat4f("projection", glm::value_ptr(projection));
-        planet.Draw(sun_shader); 
+        sun_shader.setMat4f("view"_uniform, glm::value_ptr(view));
+        sun_shader.setMat4f("projection"_uniform, glm::value_ptr(projection));
+        planet.Draw(queue, sun_shader, model);
 
         // Draw Jupyter
         planet_shader.use();
         model = glm::mat4(1.0f);
         model = glm::scale(model,glm::vec3(0.5f));
         model = glm::rotate(model,glm::radians(90.0f),glm::vec3(1.0f,0.0f,0.0f));
-        planet_shader.setMat4f("model", glm::value_ptr(model));
-        planet_shader.setMat4f("view", glm::value_ptr(view));
-        planet_shader.setMat4f("projection", glm::value_ptr(projection));
+        planet_shader.setMat4f("view"_uniform, glm::value_ptr(view));
+        planet_shader.setMat4f("projection"_uniform, glm::value_ptr(projection));
         // Phong lightning
-        planet_shader.setVec3("lightColor",glm::value_ptr(glm::vec3(1.0f)));
-        planet_shader.setVec3("lightPos",glm::value_ptr(sun_position));
-        planet_shader.setVec3("cameraPos",glm::value_ptr(camera.Position));    
-        planet.Draw(planet_shader); 
+        planet_shader.setVec3("lightColor"_uniform,glm::value_ptr(glm::vec3(1.0f)));
+        planet_shader.setVec3("lightPos"_uniform,glm::value_ptr(sun_position));
+        planet_shader.setVec3("cameraPos"_uniform,glm::value_ptr(camera.Position));    
+        planet.Draw(queue, planet_shader, model);
 
-        // Draw Asteroid
+        // Draw Asteroid, the instance transforms replace the model uniform
         asteroid_shader.use();
-        asteroid_shader.setMat4f("view", glm::value_ptr(view));
-        asteroid_shader.setMat4f("projection", glm::value_ptr(projection));
-        asteroid_shader.setInt("texture_diff",0);
+        asteroid_shader.setMat4f("view"_uniform, glm::value_ptr(view));
+        asteroid_shader.setMat4f("projection"_uniform, glm::value_ptr(projection));
+        asteroid_shader.setVec3("fieldMin"_uniform, glm::value_ptr(fieldMin));
+        asteroid_shader.setVec3("fieldExtent"_uniform, glm::value_ptr(fieldExtent));
+        asteroid_shader.setInt("texture_diff"_uniform,0);
 
         // Phong lightning
-        asteroid_shader.setVec3("lightColor",glm::value_ptr(glm::vec3(1.0f)));
-        asteroid_shader.setVec3("lightPos",glm::value_ptr(sun_position));
-        asteroid_shader.setVec3("cameraPos",glm::value_ptr(camera.Position));
+        asteroid_shader.setVec3("lightColor"_uniform,glm::value_ptr(glm::vec3(1.0f)));
+        asteroid_shader.setVec3("lightPos"_uniform,glm::value_ptr(sun_position));
+        asteroid_shader.setVec3("cameraPos"_uniform,glm::value_ptr(camera.Position));
+        // only the CPU path sorts the asteroids into impostors
+        glm::vec2 asteroidFade = cullMode == CULL_CPU && impostorsBaked ? impostorFade : glm::vec2(0.0f);
+        asteroid_shader.setVec4("boundingSphere"_uniform, glm::value_ptr(glm::vec4(rockCenter, rockRadius)));
+        asteroid_shader.setVec2("impostorFade"_uniform, glm::value_ptr(asteroidFade));
+        if (cullMode == CULL_OFF && visible > 0)
+            rock.Draw(queue, asteroid_shader, glm::mat4(1.0f), RenderPass::Opaque, (unsigned int)visible);
+
+        queue.flush();
+        unsigned long long trianglesSubmitted = queue.triangles;
+
+        // the CPU culled asteroids take an instanced draw per level of detail, each from its range of the stream
+        if (cullMode == CULL_CPU)
+        {
+            unsigned int meshLevels = rock.lodCount();
+            asteroid_shader.use();
+            for (unsigned int lod = 0; lod < culler.lodLevels() && lod <= meshLevels; lod++)
+            {
+                if (culler.lodVisible(lod) == 0)
+                    continue;
+                // the crossfade level dithers the coarsest mesh out
+                unsigned int meshLod = std::min(lod, meshLevels - 1);
+                pointInstanceAttributes(rock, visibleInstances.buffer, packedInstances, culler.lodFirst(lod));
+                for (unsigned int i = 0; i < rock.meshes.size(); i++)
+                {
+                    rock.meshes[i].bindMaterial(asteroid_shader);
+                    rock.meshes[i].drawElements((unsigned int)culler.lodVisible(lod), meshLod);
+                }
+                trianglesSubmitted += rock.lodTriangles(meshLod) * culler.lodVisible(lod);
+            }
+            boundInstanceSource = 0;
+
+            // the crossfade and impostor levels again as camera facing quads, from the start of the crossfade on
+            size_t impostorCount = 0;
+            for (unsigned int lod = meshLevels; lod < culler.lodLevels(); lod++)
+                impostorCount += culler.lodVisible(lod);
+            if (impostorsBaked && impostorCount > 0)
+            {
+                impostor_shader.use();
+                impostor_shader.setMat4f("view"_uniform, glm::value_ptr(view));
+                impostor_shader.setMat4f("projection"_uniform, glm::value_ptr(projection));
+                impostor_shader.setVec3("cameraPos"_uniform, glm::value_ptr(camera.Position));
+                impostor_shader.setVec3("lightColor"_uniform, glm::value_ptr(glm::vec3(1.0f)));
+                impostor_shader.setVec3("lightPos"_uniform, glm::value_ptr(sun_position));
+                impostor_shader.setVec3("fieldMin"_uniform, glm::value_ptr(fieldMin));
+                impostor_shader.setVec3("fieldExtent"_uniform, glm::value_ptr(fieldExtent));
+                impostor_shader.setVec2("impostorFade"_uniform, glm::value_ptr(impostorFade));
+                impostors.bind(impostor_shader, 0);
+                gl.bindVertexArray(impostors.vertexArray);
+                glBindBuffer(GL_ARRAY_BUFFER, visibleInstances.buffer);
+                if (packedInstances)
+                    PackedInstance::setupAttributes(3, culler.lodFirst(meshLevels));
+                else
+                    CompactInstance::setupAttributes(3, culler.lodFirst(meshLevels));
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                impostors.draw((unsigned int)impostorCount);
+                trianglesSubmitted += 2 * impostorCount;
+            }
+        }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, rock.textures_loaded[0].id); // note: we also made the textures_loaded vector public (instead of private) from the model class.
-        for (unsigned int i = 0; i < rock.meshes.size(); i++)
+        // the GPU culled asteroids take a draw whose instance count the CPU doesn't know, outside the queue
+        if (cullMode == CULL_GPU)
         {
-            glBindVertexArray(rock.meshes[i].VAO);
-            glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(rock.meshes[i].indices.size()), GL_UNSIGNED_INT, 0, amount);
-            glBindVertexArray(0);
+            asteroid_shader.use();
+            for (unsigned int i = 0; i < rock.meshes.size(); i++)
+            {
+                rock.meshes[i].bindMaterial(asteroid_shader);
+                gpuCuller.draw(rock.meshes[i]);
+            }
+            trianglesSubmitted += rock.lodTriangles(0) * visible;
         }
+
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        // GL objects destroyed up to here are deleted once the GPU has finished this frame
+        GpuResourcePool::instance().collect();
+
+        std::string title = "LearnOpenGL - asteroids " + std::to_string(visible) + "/" + std::to_string(amount)
+                          + " visible, cull " + CULL_MODE_NAMES[cullMode] + " " + std::to_string(cullMs) + " ms, "
+                          + std::to_string(trianglesSubmitted / 1000) + "k triangles";
+        if (cullMode == CULL_GPU)
+            title += " (gpu " + std::to_string(gpuCuller.gpuMs) + " ms)";
+        glfwSetWindowTitle(window, title.c_str());
+
+        if (firstFrame)
+        {
+            std::cout << "First frame presented after " << glfwGetTime() * 1000.0 << " ms, "
+                      << AsyncTextureLoader::instance().pending() << " texture(s) still loading" << std::endl;
+            firstFrame = false;
+        }
+        // issued vs elided state changes, once per second
+        framesSinceReport++;
+        if (glfwGetTime() - lastCounterReport >= 1.0)
+        {
+            double frameMs = (glfwGetTime() - lastCounterReport) * 1000.0 / framesSinceReport;
+            std::cout << "CULLING:: " << CULL_MODE_NAMES[cullMode] << ", " << visible << "/" << amount << " asteroids visible, cull "
+                      << cullMs << " ms";
+            if (cullMode == CULL_GPU)
+                std::cout << " (gpu " << gpuCuller.gpuMs << " ms)";
+            std::cout << ", frame " << frameMs << " ms" << std::endl;
+            std::cout << "LOD:: " << trianglesSubmitted << " triangles submitted";
+            if (cullMode == CULL_CPU)
+            {
+                std::cout << ", asteroids per level";
+                for (unsigned int lod = 0; lod < culler.lodLevels(); lod++)
+                    std::cout << " " << culler.lodVisible(lod);
+                if (culler.lodLevels() > rock.lodCount())
+                    std::cout << " (the last two are the crossfade and the impostors)";
+            }
+            std::cout << std::endl;
+            gl.printCounters("last second");
+            queue.printStats();
+            ProcessMemory::print("steady state");
+            GpuResourcePool::instance().printStats();
+            gl.resetCounters();
+            lastCounterReport = glfwGetTime();
+            framesSinceReport = 0;
+        }
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
+    // de-allocate all resources while the context is still there; the handles still held by the models, shaders and
+    // buffers above are stale afterwards and their destructors do nothing
     // ------------------------------------------------------------------------
-    delete[] modelMatrices;
+    GpuResourcePool::instance().destroyAll();
     glfwTerminate();    
     return 0;
 }
@@ -246,6 +511,14 @@ void processInput(GLFWwindow *window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // asteroid culling mode
+    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+        cullMode = CULL_CPU;
+    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+        cullMode = CULL_GPU;
+    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+        cullMode = CULL_OFF;
+
     // clavier mouvement
     float cameraSpeed = 1.0f;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
@@ -264,7 +537,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    GLState::instance().viewport(0, 0, width, height);
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -293,39 +566,30 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-unsigned int loadTexture(const char* filename,GLint mode)
+// points the instance attributes (from location 3 on) of the rock's meshes at the instances in buffer, from firstInstance on
+void pointInstanceAttributes(Model &rock, unsigned int buffer, bool packed, size_t firstInstance)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
+    GLState &gl = GLState::instance();
+    for (unsigned int i = 0; i < rock.meshes.size(); i++)
     {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
+        // Tangent and Skinned vertices use the locations the instances go to
+        VertexFormat format = rock.meshes[i].vertexFormat;
+        if (format != VertexFormat::Basic && format != VertexFormat::Quantized)
+        {
+            std::cout << "ERROR::INSTANCES:: rock mesh " << i << " has vertex attributes from location 3 on" << std::endl;
+            continue;
+        }
+        gl.bindVertexArray(rock.meshes[i].VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (packed)
+            PackedInstance::setupAttributes(3, firstInstance);
+        else
+            CompactInstance::setupAttributes(3, firstInstance);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    return textureID;
+unsigned int loadTexture(const char* filename,GLint mode)
+{
+    return TextureRegistry::instance().acquire(filename, false, mode);
 }
\ No newline at end of file
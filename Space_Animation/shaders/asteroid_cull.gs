@@ -0,0 +1,31 @@
+#version 330 core
+#ifndef INSTANCE_BYTES
+#define INSTANCE_BYTES 32
+#endif
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+flat in uvec4 vRecord0[];
+#if INSTANCE_BYTES == 32
+flat in uvec4 vRecord1[];
+#endif
+flat in int vVisible[];
+
+// captured by transform feedback, only for the instances that passed
+flat out uvec4 culledRecord0;
+#if INSTANCE_BYTES == 32
+flat out uvec4 culledRecord1;
+#endif
+
+void main()
+{
+    if (vVisible[0] == 1)
+    {
+        culledRecord0 = vRecord0[0];
+#if INSTANCE_BYTES == 32
+        culledRecord1 = vRecord1[0];
+#endif
+        EmitVertex();
+        EndPrimitive();
+    }
+}
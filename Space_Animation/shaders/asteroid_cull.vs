@@ -0,0 +1,74 @@
+#version 330 core
+#ifndef INSTANCE_BYTES
+#define INSTANCE_BYTES 32
+#endif
+// the instance record (src/instance_format.h) as raw 32-bit words, passed on untouched if it survives
+layout (location = 0) in uvec4 record0;
+#if INSTANCE_BYTES == 32
+layout (location = 1) in uvec4 record1;
+#endif
+
+flat out uvec4 vRecord0;
+#if INSTANCE_BYTES == 32
+flat out uvec4 vRecord1;
+#endif
+flat out int vVisible;
+
+uniform vec4 frustumPlanes[6];
+uniform vec4 boundingSphere; // object space center (xyz) and radius (w) of the instanced mesh
+uniform vec3 cameraPos;
+uniform float maxDistance;   // 0 disables the distance cutoff
+#if INSTANCE_BYTES == 16
+uniform vec3 fieldMin;
+uniform vec3 fieldExtent;
+#endif
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+#if INSTANCE_BYTES == 16
+float halfToFloat(uint h)
+{
+    uint exponent = (h >> 10) & 0x1fu;
+    uint mantissa = h & 0x3ffu;
+    float value = exponent == 0u ? float(mantissa) * exp2(-24.0) : (1.0 + float(mantissa) / 1024.0) * exp2(float(exponent) - 15.0);
+    return (h & 0x8000u) != 0u ? -value : value;
+}
+
+// two snorm16 values packed in a word, low half first
+vec2 snorm16x2(uint word)
+{
+    ivec2 value = ivec2(int(word << 16) >> 16, int(word) >> 16);
+    return max(vec2(value) / 32767.0, -1.0);
+}
+#endif
+
+void main()
+{
+#if INSTANCE_BYTES == 16
+    vec3 position = fieldMin + fieldExtent * vec3(record0.x & 0xffffu, record0.x >> 16, record0.y & 0xffffu) / 65535.0;
+    float scale = halfToFloat(record0.y >> 16);
+    vec4 rotation = normalize(vec4(snorm16x2(record0.z), snorm16x2(record0.w)));
+#else
+    vec3 position = uintBitsToFloat(record0.xyz);
+    float scale = uintBitsToFloat(record0.w);
+    vec4 rotation = uintBitsToFloat(record1);
+#endif
+    // bounding sphere of this instance
+    vec3 center = position + scale * rotate(rotation, boundingSphere.xyz);
+    float radius = boundingSphere.w * scale;
+
+    bool visible = true;
+    for (int i = 0; i < 6; i++)
+        visible = visible && dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w >= -radius;
+    if (maxDistance > 0.0)
+        visible = visible && distance(center, cameraPos) - radius <= maxDistance;
+
+    vRecord0 = record0;
+#if INSTANCE_BYTES == 32
+    vRecord1 = record1;
+#endif
+    vVisible = visible ? 1 : 0;
+}
@@ -2,6 +2,7 @@
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
+flat in float Fade;
 
 out vec4 FragColor;
 
@@ -11,8 +12,17 @@ uniform vec3 lightColor;
 uniform vec3 lightPos;
 uniform vec3 cameraPos;
 
+// per pixel threshold in [0, 1), the same as impostor.fs: the rock keeps the pixels its impostor leaves out
+float dither()
+{
+	return fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+}
+
 void main()
 {
+	if (Fade > dither())
+		discard;
+
 	// Ambient lighting
 	float ambientStrength = 0.005;
 	vec3 ambient = ambientStrength * lightColor;
@@ -1,20 +1,61 @@
 #version 330 core
+#ifndef INSTANCE_BYTES
+#define INSTANCE_BYTES 32
+#endif
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 TexCoords;
-layout (location = 3) in mat4 instanceMatrix;
+// per instance: translation, uniform scale and rotation quaternion (see src/instance_format.h)
+#if INSTANCE_BYTES == 16
+layout (location = 3) in vec3 instancePosition; // unorm16 inside the field bounds
+layout (location = 4) in float instanceScale;
+layout (location = 5) in vec4 instanceRotation; // snorm16
+#else
+layout (location = 3) in vec4 instancePositionScale;
+layout (location = 4) in vec4 instanceRotation;
+#endif
 
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
+flat out float Fade;
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 cameraPos;
+uniform vec4 boundingSphere; // object space center (xyz) and radius (w) of the rock
+uniform vec2 impostorFade;   // distance range (in bounding radii) over which the rock fades into its impostor, (0, 0) for none
+uniform vec3 positionOffset; // mesh position decoding, identity unless the vertices are quantized (src/vertex_format.h)
+uniform vec3 positionScale;
+#if INSTANCE_BYTES == 16
+uniform vec3 fieldMin;
+uniform vec3 fieldExtent;
+#endif
+
+// rotates v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
 void main()
 {
-    gl_Position = projection * view * instanceMatrix * vec4(aPos,1.0);
-    Normal = mat3(transpose(inverse(instanceMatrix))) * aNormal;
+#if INSTANCE_BYTES == 16
+    vec3 position = fieldMin + fieldExtent * instancePosition;
+    float scale = instanceScale;
+    vec4 rotation = normalize(instanceRotation);
+#else
+    vec3 position = instancePositionScale.xyz;
+    float scale = instancePositionScale.w;
+    vec4 rotation = instanceRotation;
+#endif
+    FragPos = position + scale * rotate(rotation, positionOffset + aPos * positionScale);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // the scale is uniform, so rotating the normal is all the normal matrix would do
+    Normal = rotate(rotation, aNormal);
     TexCoord = TexCoords;
-    FragPos = vec3(instanceMatrix * vec4(aPos, 1.0));
+
+    float radius = boundingSphere.w * scale;
+    float cameraDistance = distance(cameraPos, position + scale * rotate(rotation, boundingSphere.xyz));
+    Fade = impostorFade.y > 0.0 ? clamp((cameraDistance / radius - impostorFade.x) / max(impostorFade.y - impostorFade.x, 1e-4), 0.0, 1.0) : 0.0;
 }
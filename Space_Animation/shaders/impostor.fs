@@ -0,0 +1,45 @@
+#version 330 core
+in vec2 TexCoord;
+in vec3 FragPos;
+flat in vec4 Rotation;
+flat in float Fade;
+
+out vec4 FragColor;
+
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorNormals;
+
+uniform vec3 lightColor;
+uniform vec3 lightPos;
+uniform vec3 cameraPos;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// per pixel threshold in [0, 1), the mesh shader dithers against the same one so the crossfade leaves no holes
+float dither()
+{
+    return fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+}
+
+void main()
+{
+    vec4 albedo = texture(impostorAlbedo, TexCoord);
+    if (albedo.a < 0.5 || Fade <= dither())
+        discard;
+
+    // lit like asteroid_shader.fs, with the frame's object space normal turned with the instance
+    vec3 norm = normalize(rotate(Rotation, texture(impostorNormals, TexCoord).xyz * 2.0 - 1.0));
+    vec3 ambient = 0.005 * lightColor;
+
+    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 diffuse = max(dot(norm, lightDir), 0.0) * lightColor;
+
+    vec3 viewDir = normalize(cameraPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    vec3 specular = 0.5 * pow(max(dot(viewDir, reflectDir), 0.0), 128) * lightColor;
+
+    FragColor = vec4((ambient + diffuse + specular) * albedo.rgb, 1.0);
+}
@@ -0,0 +1,93 @@
+#version 330 core
+#ifndef INSTANCE_BYTES
+#define INSTANCE_BYTES 32
+#endif
+// corner of the unit quad
+layout (location = 0) in vec2 aCorner;
+// per instance: translation, uniform scale and rotation quaternion (see src/instance_format.h)
+#if INSTANCE_BYTES == 16
+layout (location = 3) in vec3 instancePosition; // unorm16 inside the field bounds
+layout (location = 4) in float instanceScale;
+layout (location = 5) in vec4 instanceRotation; // snorm16
+#else
+layout (location = 3) in vec4 instancePositionScale;
+layout (location = 4) in vec4 instanceRotation;
+#endif
+
+out vec2 TexCoord;
+out vec3 FragPos;
+flat out vec4 Rotation;
+flat out float Fade;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPos;
+uniform float framesPerSide;
+uniform vec4 impostorSphere; // object space sphere the frames were rendered around
+uniform vec2 impostorFade;   // distance range (in bounding radii) over which the impostors fade in
+#if INSTANCE_BYTES == 16
+uniform vec3 fieldMin;
+uniform vec3 fieldExtent;
+#endif
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// octahedral mapping, the same as ImpostorAtlas::octEncode/octDecode (src/impostor.h)
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.xz;
+    if (n.y < 0.0)
+        p = (1.0 - abs(p.yx)) * signNotZero(p);
+    return p;
+}
+
+vec3 octDecode(vec2 p)
+{
+    vec3 n = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (n.y < 0.0)
+        n.xz = (1.0 - abs(n.zx)) * signNotZero(n.xz);
+    return normalize(n);
+}
+
+void main()
+{
+#if INSTANCE_BYTES == 16
+    vec3 position = fieldMin + fieldExtent * instancePosition;
+    float scale = instanceScale;
+    vec4 rotation = normalize(instanceRotation);
+#else
+    vec3 position = instancePositionScale.xyz;
+    float scale = instancePositionScale.w;
+    vec4 rotation = instanceRotation;
+#endif
+    vec3 center = position + scale * rotate(rotation, impostorSphere.xyz);
+
+    // the frame whose direction is closest to the camera, seen from the instance's object space
+    vec4 inverseRotation = vec4(-rotation.xyz, rotation.w);
+    vec3 toCamera = normalize(rotate(inverseRotation, cameraPos - center));
+    vec2 cell = clamp(floor((octEncode(toCamera) * 0.5 + 0.5) * framesPerSide), 0.0, framesPerSide - 1.0);
+    vec3 direction = octDecode((cell + 0.5) / framesPerSide * 2.0 - 1.0);
+
+    // the quad in that frame's basis (ImpostorAtlas::frameBasis), so it lines up with the picture
+    vec3 reference = abs(direction.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(-direction, reference));
+    vec3 up = cross(right, -direction);
+    vec3 corner = impostorSphere.xyz + (aCorner.x * right + aCorner.y * up) * impostorSphere.w;
+
+    FragPos = position + scale * rotate(rotation, corner);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    TexCoord = (cell + aCorner * 0.5 + 0.5) / framesPerSide;
+    Rotation = rotation;
+
+    float radius = impostorSphere.w * scale;
+    Fade = clamp((distance(cameraPos, center) / radius - impostorFade.x) / max(impostorFade.y - impostorFade.x, 1e-4), 0.0, 1.0);
+}
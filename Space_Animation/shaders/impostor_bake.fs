@@ -0,0 +1,15 @@
+#version 330 core
+in vec2 TexCoord;
+in vec3 Normal;
+
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 ObjectNormal;
+
+uniform sampler2D texture_diffuse1;
+
+void main()
+{
+    // unlit, the impostor shader lights the frames per instance
+    Albedo = vec4(texture(texture_diffuse1, TexCoord).rgb, 1.0);
+    ObjectNormal = vec4(normalize(Normal) * 0.5 + 0.5, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoord;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 positionOffset; // mesh position decoding, identity unless the vertices are quantized (src/vertex_format.h)
+uniform vec3 positionScale;
+
+// the model in object space, it is rendered around its own bounding sphere
+void main()
+{
+    gl_Position = projection * view * vec4(positionOffset + aPos * positionScale, 1.0);
+    Normal = aNormal;
+    TexCoord = aTexCoords;
+}
@@ -8,13 +8,17 @@ out vec3 Normal;
 out vec3 FragPos;
 
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of model, from the CPU
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 positionOffset; // mesh position decoding, identity unless the vertices are quantized (src/vertex_format.h)
+uniform vec3 positionScale;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos,1.0);
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec3 position = positionOffset + aPos * positionScale;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    Normal = normalMatrix * aNormal;
     TexCoord = TexCoords;
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(model * vec4(position, 1.0));
 }
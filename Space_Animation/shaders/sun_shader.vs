@@ -5,8 +5,10 @@ layout (location = 2) in vec2 aTexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 positionOffset; // mesh position decoding, identity unless the vertices are quantized (src/vertex_format.h)
+uniform vec3 positionScale;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos,1.0);
+    gl_Position = projection * view * model * vec4(positionOffset + aPos * positionScale, 1.0);
 }
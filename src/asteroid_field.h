@@ -0,0 +1,107 @@
+#ifndef ASTEROID_FIELD_H
+#define ASTEROID_FIELD_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "frustum_culling.h"
+#include "instance_format.h"
+#include "philox.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// shape of a ring of asteroids around the origin
+struct AsteroidFieldSettings {
+    float radius = 2500.0f;
+    float offset = 500.0f;      // random displacement in [-offset, offset) from the ring
+    float heightScale = 0.2f;   // the vertical displacement is scaled down by this, for a flat ring
+    float minScale = 0.05f;
+    float maxScale = 0.3f;
+    glm::vec3 rotationAxis = glm::vec3(0.4f, 0.6f, 0.8f);
+    uint64_t seed = 1;
+};
+
+// Generates the instances of an asteroid ring on the shared thread pool. Asteroid i is a pure function of
+// (seed, i, count): its random numbers are the Philox block of counter i, so the field comes out bit for bit the
+// same for a given seed whatever the number of threads and the order the chunks run in.
+class AsteroidField {
+public:
+    AsteroidFieldSettings settings;
+    // instances per job; only a scheduling unit, the output doesn't depend on it
+    size_t chunkSize = 16384;
+
+    vector<CompactInstance> instances;
+    // bounding sphere of every instance, from the instanced mesh's object space sphere
+    BoundingSpheres bounds;
+    // box around the instance positions
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+
+    void generate(unsigned int count, const glm::vec3 &meshCenter, float meshRadius)
+    {
+        instances.resize(count);
+        bounds.resize(count);
+        size_t chunks = (count + chunkSize - 1) / chunkSize;
+        vector<glm::vec3> chunkMin(chunks, glm::vec3(INFINITY)), chunkMax(chunks, glm::vec3(-INFINITY));
+        uint32_t key[2];
+        Philox::key(settings.seed, key);
+        glm::vec3 axis = glm::normalize(settings.rotationAxis);
+
+        ThreadPool::shared().parallelFor(chunks, 1, [&](size_t firstChunk, size_t lastChunk)
+        {
+            for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+            {
+                size_t begin = chunk * chunkSize;
+                size_t end = min<size_t>(count, begin + chunkSize);
+                uint32_t random[4][4];
+                for (size_t group = begin; group < end; group += 4)
+                {
+                    // 4 instances' worth of random words at once
+                    Philox::block4((uint32_t)group, 0, 0, 0, key, random);
+                    for (size_t lane = 0; lane < 4 && group + lane < end; lane++)
+                    {
+                        uint32_t words[4] = {random[0][lane], random[1][lane], random[2][lane], random[3][lane]};
+                        CompactInstance instance = make((uint32_t)(group + lane), count, words, axis);
+                        glm::vec3 position(instance.position);
+                        glm::quat rotation(instance.rotation.w, instance.rotation.x, instance.rotation.y, instance.rotation.z);
+                        instances[group + lane] = instance;
+                        bounds.set(group + lane, position + instance.scale * (rotation * meshCenter), meshRadius * instance.scale);
+                        chunkMin[chunk] = glm::min(chunkMin[chunk], position);
+                        chunkMax[chunk] = glm::max(chunkMax[chunk], position);
+                    }
+                }
+            }
+        });
+
+        boundsMin = glm::vec3(INFINITY);
+        boundsMax = glm::vec3(-INFINITY);
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+        {
+            boundsMin = glm::min(boundsMin, chunkMin[chunk]);
+            boundsMax = glm::max(boundsMax, chunkMax[chunk]);
+        }
+        if (count == 0)
+            boundsMin = boundsMax = glm::vec3(0.0f);
+    }
+
+private:
+    // asteroid index of count from its 4 random words
+    CompactInstance make(uint32_t index, uint32_t count, const uint32_t words[4], const glm::vec3 &axis) const
+    {
+        // 1. translation: displace along circle with 'radius' in range [-offset, offset]
+        float angle = (float)index / (float)count * 360.0f;
+        float x = sin(angle) * settings.radius + (Philox::unit(words[0]) * 2.0f - 1.0f) * settings.offset;
+        float y = (Philox::unit(words[1]) * 2.0f - 1.0f) * settings.offset * settings.heightScale;
+        float z = cos(angle) * settings.radius + (Philox::unit(words[2]) * 2.0f - 1.0f) * settings.offset;
+
+        // 2. scale and 3. rotation around the axis share the last word, 16 bits each is plenty
+        float scale = settings.minScale + (settings.maxScale - settings.minScale) * (float)(words[3] & 0xffffu) / 65536.0f;
+        float rotationAngle = (float)(words[3] >> 16) / 65536.0f * 6.28318531f;
+        return CompactInstance::make(glm::vec3(x, y, z), scale, glm::angleAxis(rotationAngle, axis));
+    }
+};
+#endif
@@ -0,0 +1,249 @@
+#ifndef ASYNC_TEXTURE_LOADER_H
+#define ASYNC_TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "gl_state.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Loads 2D textures without stalling the render thread: images are decoded on the shared thread pool, copied into a
+// pixel buffer object a few megabytes per frame and only then handed to glTexImage2D, which sources from the PBO
+// without blocking. Until its upload is finished a texture holds a 1x1 placeholder, so it can be bound right away.
+class AsyncTextureLoader {
+public:
+    // bytes copied into pixel buffers per update(), keeps each frame's share of the upload work bounded
+    size_t bytesPerFrame = 4 * 1024 * 1024;
+    // called on the context thread when a texture got its final image, with its size including the mipmaps
+    function<void(unsigned int textureID, size_t bytes)> onUploaded;
+
+    static AsyncTextureLoader& instance()
+    {
+        static AsyncTextureLoader loader;
+        return loader;
+    }
+
+    // creates the texture holding a placeholder and starts decoding path in the background
+    unsigned int load(const string &path, bool gamma, GLint wrap)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+        const unsigned char placeholder[4] = {128, 128, 128, 255};
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // requests are told apart by serial: a name freed by release() can come back from glGenTextures while the
+        // decode of its previous texture is still running
+        uint64_t serial = ++lastSerial;
+        inFlight[textureID] = serial;
+        shared_ptr<DecodedQueue> queue = decoded;
+        ThreadPool::shared().submit([queue, path, gamma, textureID, serial]()
+        {
+            auto start = chrono::steady_clock::now();
+            DecodedImage image;
+            image.textureID = textureID;
+            image.serial = serial;
+            image.path = path;
+            image.gamma = gamma;
+            image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+            image.decodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+            lock_guard<mutex> lock(queue->queueMutex);
+            queue->images.push_back(image);
+        });
+        return textureID;
+    }
+
+    // forgets a texture that is about to be deleted, its pending upload (if any) is dropped
+    void cancel(unsigned int textureID)
+    {
+        auto it = inFlight.find(textureID);
+        if (it == inFlight.end())
+            return;
+        cancelled.insert(it->second);
+        inFlight.erase(it);
+    }
+
+    // number of textures whose final image isn't resident yet
+    size_t pending() const { return inFlight.size(); }
+
+    // true while textureID still holds its placeholder
+    bool isPending(unsigned int textureID) const { return inFlight.count(textureID) > 0; }
+
+    // advances the uploads, call once per frame on the context thread
+    void update()
+    {
+        {
+            lock_guard<mutex> lock(decoded->queueMutex);
+            for (DecodedImage &image : decoded->images)
+            {
+                Upload upload;
+                upload.image = image;
+                uploads.push_back(std::move(upload));
+            }
+            decoded->images.clear();
+        }
+
+        size_t budget = bytesPerFrame;
+        while (!uploads.empty() && budget > 0)
+        {
+            Upload &upload = uploads.front();
+            if (cancelled.count(upload.image.serial) || !upload.image.pixels)
+            {
+                if (!upload.image.pixels)
+                    cout << "Texture failed to load at path: " << upload.image.path << endl;
+                finish(upload, false);
+                continue;
+            }
+
+            size_t size = (size_t)upload.image.width * upload.image.height * upload.image.components;
+            if (upload.pbo == 0)
+            {
+                upload.start = chrono::steady_clock::now();
+                glGenBuffers(1, &upload.pbo);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+                upload.mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+                if (!upload.mapped)
+                {
+                    // out of memory or the driver refused the mapping: upload straight from the decoded pixels instead
+                    cout << "WARNING::ASYNC_TEXTURE:: could not map a pixel buffer for " << upload.image.path
+                         << ", uploading directly" << endl;
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    glDeleteBuffers(1, &upload.pbo);
+                    upload.pbo = 0;
+                    upload.frames = 1;
+                    budget -= min(budget, size);
+                    uploadTexture(upload.image, upload.image.pixels);
+                    finish(upload, true);
+                    continue;
+                }
+            }
+
+            // copy this frame's slice of the image into the pixel buffer
+            size_t chunk = min(budget, size - upload.copied);
+            memcpy(upload.mapped + upload.copied, upload.image.pixels + upload.copied, chunk);
+            upload.copied += chunk;
+            upload.frames++;
+            budget -= chunk;
+            if (upload.copied < size)
+                break;
+
+            // fully staged: source the texture from the pixel buffer, the driver transfers it asynchronously
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            uploadTexture(upload.image, 0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            finish(upload, true);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+private:
+    struct DecodedImage {
+        unsigned int textureID = 0;
+        uint64_t serial = 0;
+        string path;
+        bool gamma = false;
+        int width = 0, height = 0, components = 0;
+        unsigned char *pixels = nullptr;
+        double decodeMs = 0.0;
+    };
+    // filled by the decode jobs; shared with them so it outlives the loader at shutdown
+    struct DecodedQueue {
+        mutex queueMutex;
+        vector<DecodedImage> images;
+    };
+    struct Upload {
+        DecodedImage image;
+        unsigned int pbo = 0;
+        unsigned char *mapped = nullptr;
+        size_t copied = 0;
+        unsigned int frames = 0;
+        chrono::steady_clock::time_point start;
+    };
+
+    shared_ptr<DecodedQueue> decoded = make_shared<DecodedQueue>();
+    deque<Upload> uploads;
+    unordered_map<unsigned int, uint64_t> inFlight; // texture name -> serial of its pending request
+    unordered_set<uint64_t> cancelled;              // serials
+    uint64_t lastSerial = 0;
+
+    AsyncTextureLoader() {}
+    AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+    AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+    // gives the texture its final image from pixels, an offset into the bound pixel buffer if there is one
+    static void uploadTexture(const DecodedImage &image, const void *pixels)
+    {
+        GLenum format = GL_RGB;
+        GLenum internalFormat = GL_RGB;
+        if (image.components == 1)
+            format = internalFormat = GL_RED;
+        else if (image.components == 3)
+            internalFormat = image.gamma ? GL_SRGB : GL_RGB;
+        else if (image.components == 4)
+        {
+            format = GL_RGBA;
+            internalFormat = image.gamma ? GL_SRGB_ALPHA : GL_RGBA;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of RGB images aren't 4 byte aligned
+        GLState::instance().bindTexture(GL_TEXTURE_2D, image.textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    void finish(Upload &upload, bool uploaded)
+    {
+        if (upload.pbo)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+            if (!uploaded)
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &upload.pbo);
+        }
+        if (uploaded)
+        {
+            double uploadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - upload.start).count();
+            cout << "ASYNC_TEXTURE:: " << upload.image.path << " " << upload.image.width << "x" << upload.image.height
+                 << " decoded in " << upload.image.decodeMs << " ms, uploaded in " << uploadMs << " ms over "
+                 << upload.frames << " frame(s)" << endl;
+            if (onUploaded)
+                onUploaded(upload.image.textureID, (size_t)upload.image.width * upload.image.height * upload.image.components * 4 / 3);
+        }
+        stbi_image_free(upload.image.pixels);
+        // a cancelled request's name may already belong to a newer one
+        auto it = inFlight.find(upload.image.textureID);
+        bool current = it != inFlight.end() && it->second == upload.image.serial;
+        if (current)
+            inFlight.erase(it);
+        cancelled.erase(upload.image.serial);
+        uploads.pop_front();
+        if (current && inFlight.empty())
+            cout << "ASYNC_TEXTURE:: all textures resident" << endl;
+    }
+};
+#endif
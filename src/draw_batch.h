@@ -0,0 +1,110 @@
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "gpu_resource.h"
+#include "mesh.h"
+
+using namespace std;
+
+// Collects the index ranges of meshes that can be drawn with the same state (same arena VAO and index type, with the
+// program, material and uniforms the caller has set) and issues them as one multi-draw when flushed:
+// glMultiDrawElementsIndirect from a command buffer where ARB_multi_draw_indirect is available, otherwise
+// glMultiDrawElementsBaseVertex (core since 3.2). The latter has no instanced form, so instanced batches without
+// indirect support fall back to a draw per range.
+class DrawBatch {
+public:
+    // use the indirect path when the context has it
+    bool allowIndirect = true;
+
+    DrawBatch() {}
+    DrawBatch(const DrawBatch&) = delete;
+    DrawBatch& operator=(const DrawBatch&) = delete;
+
+    bool empty() const { return counts.empty(); }
+
+    // whether mesh, drawn instanceCount times, can join what is already batched
+    bool accepts(const Mesh &mesh, unsigned int instanceCount) const
+    {
+        return empty() || (mesh.VAO == vertexArray && mesh.indexType == indexType && instanceCount == instances);
+    }
+
+    // adds level lod of mesh; check accepts() first
+    void add(const Mesh &mesh, unsigned int lod = 0, unsigned int instanceCount = 1)
+    {
+        vertexArray = mesh.VAO;
+        indexType = mesh.indexType;
+        instances = instanceCount;
+        lod = (unsigned int)min<size_t>(lod, mesh.lods.size() - 1);
+        for (unsigned int s = mesh.lodSegments[lod]; s < mesh.lodSegments[lod + 1]; s++)
+        {
+            const MeshIndexSegment &segment = mesh.segments[s];
+            counts.push_back((GLsizei)segment.indexCount);
+            firstIndices.push_back(mesh.arenaFirstIndex(segment));
+            baseVertices.push_back(mesh.arenaBaseVertex(segment));
+        }
+    }
+
+    // issues and empties the batch, returns the number of draw calls it took
+    unsigned int flush()
+    {
+        if (empty())
+            return 0;
+        GLState::instance().bindVertexArray(vertexArray);
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        unsigned int calls = 0;
+        GLExtensions &ext = glExtensions();
+        if (allowIndirect && ext.multiDrawIndirect)
+        {
+            commands.resize(counts.size());
+            for (size_t i = 0; i < counts.size(); i++)
+                commands[i] = DrawElementsIndirectCommand{(GLuint)counts[i], instances, firstIndices[i], baseVertices[i], 0};
+            if (!commandBuffer)
+                commandBuffer = GpuBuffer::create();
+            commandBuffer.setBytes(commands.size() * sizeof(DrawElementsIndirectCommand));
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.id());
+            // orphaned every time, the driver hands out fresh storage instead of waiting for the previous batch
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+            ext.MultiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void*)0, (GLsizei)commands.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            calls = 1;
+        }
+        else if (instances == 1)
+        {
+            offsets.resize(counts.size());
+            for (size_t i = 0; i < counts.size(); i++)
+                offsets[i] = (const void*)(firstIndices[i] * indexSize);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, (void* const*)offsets.data(),
+                                          (GLsizei)counts.size(), baseVertices.data());
+            calls = 1;
+        }
+        else
+        {
+            for (size_t i = 0; i < counts.size(); i++)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, counts[i], indexType, (const void*)(firstIndices[i] * indexSize),
+                                                  instances, baseVertices[i]);
+            calls = (unsigned int)counts.size();
+        }
+        counts.clear();
+        firstIndices.clear();
+        baseVertices.clear();
+        return calls;
+    }
+
+private:
+    unsigned int vertexArray = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    unsigned int instances = 1;
+    vector<GLsizei> counts;
+    vector<GLuint> firstIndices;
+    vector<GLint> baseVertices;
+    vector<const void*> offsets;
+    vector<DrawElementsIndirectCommand> commands;
+    GpuBuffer commandBuffer;
+};
+#endif
@@ -0,0 +1,333 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+#include <vector>
+
+#include "camera.h"
+#include "gpu_resource.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// view frustum as six planes (xyz = inward normal, w = distance), world space
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // planes of a projection * view matrix (Gribb & Hartmann)
+    static Frustum fromMatrix(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        Frustum frustum;
+        frustum.planes[0] = row[3] + row[0]; // left
+        frustum.planes[1] = row[3] - row[0]; // right
+        frustum.planes[2] = row[3] + row[1]; // bottom
+        frustum.planes[3] = row[3] - row[1]; // top
+        frustum.planes[4] = row[3] + row[2]; // near
+        frustum.planes[5] = row[3] - row[2]; // far
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // frustum of the camera's view with a perspective of the camera's zoom
+    static Frustum fromCamera(Camera &camera, float aspect, float nearPlane, float farPlane)
+    {
+        return fromMatrix(glm::perspective(glm::radians(camera.Zoom), aspect, nearPlane, farPlane) * camera.GetViewMatrix());
+    }
+
+    bool containsSphere(const glm::vec3 &center, float radius) const
+    {
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+};
+
+// bounding spheres in structure of arrays layout, so a SIMD register holds the same component of 8 (or 4) spheres
+struct BoundingSpheres {
+    vector<float> x, y, z, radius;
+
+    size_t size() const { return x.size(); }
+    void resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+    void set(size_t i, const glm::vec3 &center, float r)
+    {
+        x[i] = center.x;
+        y[i] = center.y;
+        z[i] = center.z;
+        radius[i] = r;
+    }
+};
+
+// Culls instances against a frustum on the shared thread pool in two passes:
+//     cull()    tests the bounding spheres chunk by chunk and records the indices of the visible ones
+//     compact() copies the visible instance records, in their original order, to one contiguous destination
+// so the destination (typically a mapped buffer) can be sized to the visible count in between. An optional
+// selectLods() between the two groups the visible instances by level of detail, compact() then writes one contiguous
+// range per level.
+class FrustumCuller {
+public:
+    // spheres per job, big enough that a job outweighs its scheduling
+    size_t chunkSize = 16384;
+
+    // tests all spheres, returns the number of visible ones
+    size_t cull(const Frustum &frustum, const BoundingSpheres &spheres)
+    {
+        size_t count = spheres.size();
+        size_t chunks = (count + chunkSize - 1) / chunkSize;
+        visibleIndices.resize(count);
+        chunkVisible.assign(chunks, 0);
+        chunkOffsets.resize(chunks);
+
+        ThreadPool::shared().parallelFor(chunks, 1, [&](size_t firstChunk, size_t lastChunk)
+        {
+            for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+            {
+                size_t begin = chunk * chunkSize;
+                size_t end = min(count, begin + chunkSize);
+                chunkVisible[chunk] = (uint32_t)cullRange(frustum, spheres, begin, end, visibleIndices.data() + begin);
+            }
+        });
+
+        visible = 0;
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+        {
+            chunkOffsets[chunk] = visible;
+            visible += chunkVisible[chunk];
+        }
+        levels = 1;
+        lodCounts.assign(1, visible);
+        lodFirsts.assign(1, 0);
+        return visible;
+    }
+
+    // visible count of the last cull()
+    size_t visibleCount() const { return visible; }
+
+    // picks a level of detail for every instance visible in the last cull(): level i once the instance's distance to
+    // viewer reaches lodDistances[i - 1] times its sphere's radius (ascending, one entry per level after the first)
+    void selectLods(const BoundingSpheres &spheres, const glm::vec3 &viewer, const vector<float> &lodDistances)
+    {
+        size_t chunks = chunkVisible.size();
+        levels = min(lodDistances.size() + 1, MAX_LEVELS);
+        visibleLods.resize(visibleIndices.size());
+        chunkLodOffsets.assign(chunks * levels, 0);
+
+        ThreadPool::shared().parallelFor(chunks, 1, [&](size_t firstChunk, size_t lastChunk)
+        {
+            for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+            {
+                const uint32_t *indices = visibleIndices.data() + chunk * chunkSize;
+                unsigned char *lods = visibleLods.data() + chunk * chunkSize;
+                size_t *counts = chunkLodOffsets.data() + chunk * levels;
+                for (uint32_t i = 0; i < chunkVisible[chunk]; i++)
+                {
+                    uint32_t index = indices[i];
+                    float dx = spheres.x[index] - viewer.x, dy = spheres.y[index] - viewer.y, dz = spheres.z[index] - viewer.z;
+                    float distanceSquared = dx * dx + dy * dy + dz * dz;
+                    float radius = spheres.radius[index];
+                    size_t lod = 0;
+                    while (lod + 1 < levels && distanceSquared >= lodDistances[lod] * lodDistances[lod] * radius * radius)
+                        lod++;
+                    lods[i] = (unsigned char)lod;
+                    counts[lod]++;
+                }
+            }
+        });
+
+        // levels one after the other, within a level the chunks in order
+        lodCounts.assign(levels, 0);
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+            for (size_t lod = 0; lod < levels; lod++)
+                lodCounts[lod] += chunkLodOffsets[chunk * levels + lod];
+        lodFirsts.assign(levels, 0);
+        for (size_t lod = 1; lod < levels; lod++)
+            lodFirsts[lod] = lodFirsts[lod - 1] + lodCounts[lod - 1];
+        vector<size_t> next(lodFirsts);
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+            for (size_t lod = 0; lod < levels; lod++)
+            {
+                size_t count = chunkLodOffsets[chunk * levels + lod];
+                chunkLodOffsets[chunk * levels + lod] = next[lod];
+                next[lod] += count;
+            }
+    }
+
+    // levels of detail of the last cull() (1 without selectLods()), and where compact() puts each level's instances
+    size_t lodLevels() const { return levels; }
+    size_t lodVisible(size_t lod) const { return lodCounts[lod]; }
+    size_t lodFirst(size_t lod) const { return lodFirsts[lod]; }
+
+    // copies the records of the instances visible in the last cull() to destination, which holds visibleCount() records
+    template<typename Instance>
+    void compact(const Instance *instances, Instance *destination) const
+    {
+        ThreadPool::shared().parallelFor(chunkVisible.size(), 1, [&](size_t firstChunk, size_t lastChunk)
+        {
+            for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+            {
+                const uint32_t *indices = visibleIndices.data() + chunk * chunkSize;
+                if (levels == 1)
+                {
+                    Instance *out = destination + chunkOffsets[chunk];
+                    for (uint32_t i = 0; i < chunkVisible[chunk]; i++)
+                        out[i] = instances[indices[i]];
+                    continue;
+                }
+                const unsigned char *lods = visibleLods.data() + chunk * chunkSize;
+                size_t next[MAX_LEVELS];
+                for (size_t lod = 0; lod < levels; lod++)
+                    next[lod] = chunkLodOffsets[chunk * levels + lod];
+                for (uint32_t i = 0; i < chunkVisible[chunk]; i++)
+                    destination[next[lods[i]]++] = instances[indices[i]];
+            }
+        });
+    }
+
+    // most levels of detail selectLods() can tell apart
+    static constexpr size_t MAX_LEVELS = 16;
+
+private:
+    vector<uint32_t> visibleIndices; // per chunk, starting at the chunk's first sphere
+    vector<uint32_t> chunkVisible;
+    vector<size_t> chunkOffsets;
+    size_t visible = 0;
+    // level of detail of each visible index, and per chunk and level where compact() writes
+    vector<unsigned char> visibleLods;
+    vector<size_t> chunkLodOffsets;
+    vector<size_t> lodCounts;
+    vector<size_t> lodFirsts;
+    size_t levels = 1;
+
+    static int lowestBit(unsigned int mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int)index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // writes the indices of the spheres in [begin, end) inside the frustum to out, returns how many
+    static size_t cullRange(const Frustum &frustum, const BoundingSpheres &spheres, size_t begin, size_t end, uint32_t *out)
+    {
+        const float *xs = spheres.x.data(), *ys = spheres.y.data(), *zs = spheres.z.data(), *rs = spheres.radius.data();
+        size_t written = 0;
+        size_t i = begin;
+#if defined(__AVX2__)
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+        }
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i), z = _mm256_loadu_ps(zs + i);
+            __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(rs + i));
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+                                                _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+            }
+            for (unsigned int mask = (unsigned int)_mm256_movemask_ps(inside); mask; mask &= mask - 1)
+                out[written++] = (uint32_t)(i + lowestBit(mask));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i), z = _mm_loadu_ps(zs + i);
+            __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(rs + i));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                                             _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+            }
+            for (unsigned int mask = (unsigned int)_mm_movemask_ps(inside); mask; mask &= mask - 1)
+                out[written++] = (uint32_t)(i + lowestBit(mask));
+        }
+#endif
+        // scalar tail (and fallback without SSE)
+        for (; i < end; i++)
+            if (frustum.containsSphere(glm::vec3(xs[i], ys[i], zs[i]), rs[i]))
+                out[written++] = (uint32_t)i;
+        return written;
+    }
+};
+
+// Vertex buffer refilled from scratch every frame. Each map() orphans the previous storage, so the driver can hand
+// out fresh memory while the GPU still reads last frame's data, and we never wait on it.
+class InstanceStream {
+public:
+    unsigned int buffer = 0;
+
+    InstanceStream() : storage(GpuBuffer::create()) { buffer = storage.id(); }
+    InstanceStream(const InstanceStream&) = delete;
+    InstanceStream& operator=(const InstanceStream&) = delete;
+
+    // returns bytes of writable memory (nullptr for 0 bytes), valid until unmap(). Leaves the buffer bound to
+    // GL_ARRAY_BUFFER; the memory may be written from any thread.
+    void* map(size_t bytes)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        // keep the storage size stable so the driver can recycle orphaned blocks
+        if (bytes > capacity)
+        {
+            capacity = bytes + bytes / 4;
+            storage.setBytes(capacity);
+        }
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        mapped = bytes ? glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT) : nullptr;
+        return mapped;
+    }
+
+    void unmap()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (mapped)
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        mapped = nullptr;
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    GpuBuffer storage; // owns buffer
+    size_t capacity = 0;
+    void *mapped = nullptr;
+};
+#endif
@@ -0,0 +1,123 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// The bundled glad loader is generated for plain GL 3.3 core without extensions. The few newer entry points we can
+// make use of are loaded here, after gladLoadGLLoader, with the same loader function:
+//     loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+// Every feature has an availability flag; code using it falls back to the GL 3.3 path when the flag is false, so a
+// program that never calls loadGLExtensions still runs, just without the program binary cache, the indirect
+// multi-draws and the query buffers of the helpers in src/. Every demo calls it right after gladLoadGLLoader.
+
+// ARB_get_program_binary (core in 4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+// ARB_draw_indirect (core in 4.0)
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+typedef void (APIENTRYP PFNGLDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect);
+
+// ARB_multi_draw_indirect (core in 4.3)
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+
+// ARB_query_buffer_object (core in 4.4), no entry points: query results can be written to a buffer
+#ifndef GL_QUERY_BUFFER
+#define GL_QUERY_BUFFER 0x9192
+#endif
+
+// command layout read by glDrawElementsIndirect and glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance; // must be 0 before GL 4.2
+};
+
+struct GLExtensions {
+    bool loaded = false;
+
+    bool programBinary = false;
+    PFNGLGETPROGRAMBINARYPROC GetProgramBinary = nullptr;
+    PFNGLPROGRAMBINARYPROC ProgramBinary = nullptr;
+    PFNGLPROGRAMPARAMETERIPROC ProgramParameteri = nullptr;
+
+    bool drawIndirect = false;
+    PFNGLDRAWELEMENTSINDIRECTPROC DrawElementsIndirect = nullptr;
+
+    bool multiDrawIndirect = false;
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect = nullptr;
+
+    bool queryBuffer = false;
+};
+
+inline GLExtensions& glExtensions()
+{
+    static GLExtensions extensions;
+    return extensions;
+}
+
+// true if the current context advertises the extension, or is at least GL major.minor where it became core
+inline bool hasGLExtension(const char *name, int coreMajor, int coreMinor)
+{
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > coreMajor || (major == coreMajor && minor >= coreMinor))
+        return true;
+
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++)
+    {
+        const char *extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// call once after gladLoadGLLoader with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensions &ext = glExtensions();
+    ext.loaded = true;
+
+    if (hasGLExtension("GL_ARB_get_program_binary", 4, 1))
+    {
+        ext.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        ext.ProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        ext.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // some drivers expose the entry points but no binary format, caching is pointless there
+        ext.programBinary = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && formats > 0;
+    }
+
+    if (hasGLExtension("GL_ARB_draw_indirect", 4, 0))
+    {
+        ext.DrawElementsIndirect = (PFNGLDRAWELEMENTSINDIRECTPROC)load("glDrawElementsIndirect");
+        ext.drawIndirect = ext.DrawElementsIndirect != nullptr;
+    }
+
+    if (ext.drawIndirect && hasGLExtension("GL_ARB_multi_draw_indirect", 4, 3))
+    {
+        ext.MultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+        ext.multiDrawIndirect = ext.MultiDrawElementsIndirect != nullptr;
+    }
+
+    ext.queryBuffer = hasGLExtension("GL_ARB_query_buffer_object", 4, 4);
+}
+#endif
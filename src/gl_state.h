@@ -0,0 +1,300 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Shadow copy of the GL state our render loops touch most: bound program, VAO, active texture unit, per-unit texture
+// bindings, framebuffer, viewport and, per program, the last value written to each uniform location.
+// Calls that wouldn't change anything are dropped before they reach the driver and counted as elided.
+//
+// The shadow is only right if every change goes through this class. Tracking is therefore opt-in (`enabled`): while it
+// is off every call is issued as is, so code still mixing in raw gl* calls keeps working. Call invalidate() after
+// raw calls the shadow can't know about.
+class GLState {
+public:
+    enum CallKind { Program, VertexArray, ActiveTexture, Texture, Framebuffer, Viewport, Uniform, KindCount };
+
+    bool enabled = false;
+    // calls that reached the driver / calls that were dropped, per kind
+    unsigned long long issued[KindCount] = {};
+    unsigned long long elided[KindCount] = {};
+
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if (skip(Program, program == currentProgram))
+            return;
+        currentProgram = program;
+        glUseProgram(program);
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if (skip(VertexArray, vao == currentVertexArray))
+            return;
+        currentVertexArray = vao;
+        glBindVertexArray(vao);
+    }
+
+    // takes the unit index (0, 1, ...), not GL_TEXTUREi
+    void activeTexture(unsigned int unit)
+    {
+        if (skip(ActiveTexture, unit == currentUnit))
+            return;
+        currentUnit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void bindTexture(GLenum target, unsigned int texture)
+    {
+        int slot = targetSlot(target);
+        if (slot < 0 || currentUnit >= MAX_UNITS)
+        {
+            issued[Texture]++;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (skip(Texture, boundTextures[currentUnit][slot] == texture))
+            return;
+        boundTextures[currentUnit][slot] = texture;
+        glBindTexture(target, texture);
+    }
+
+    // binds texture to unit. The active unit only changes (to unit) when a bind is actually issued: if texture is
+    // already bound there the call returns without touching it, so follow up with activeTexture(unit) before raw
+    // glTexParameteri or glBindTexture calls meant for unit.
+    void bindTextureUnit(unsigned int unit, GLenum target, unsigned int texture)
+    {
+        int slot = targetSlot(target);
+        // don't switch units just to find out the binding is already right
+        if (enabled && slot >= 0 && unit < MAX_UNITS && boundTextures[unit][slot] == texture)
+        {
+            elided[Texture]++;
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    void bindFramebuffer(unsigned int framebuffer)
+    {
+        if (skip(Framebuffer, framebuffer == currentFramebuffer))
+            return;
+        currentFramebuffer = framebuffer;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    void viewport(int x, int y, int width, int height)
+    {
+        int value[4] = {x, y, width, height};
+        if (skip(Viewport, memcmp(value, currentViewport, sizeof(value)) == 0))
+            return;
+        memcpy(currentViewport, value, sizeof(value));
+        glViewport(x, y, width, height);
+    }
+
+    // uniform writes to the currently bound program; program is the one the location belongs to
+    void uniform1i(unsigned int program, int location, int value)
+    {
+        if (!uniformChanged(program, location, &value, sizeof(value)))
+            return;
+        glUniform1i(location, value);
+    }
+    void uniform1f(unsigned int program, int location, float value)
+    {
+        if (!uniformChanged(program, location, &value, sizeof(value)))
+            return;
+        glUniform1f(location, value);
+    }
+    void uniform2fv(unsigned int program, int location, const float *value)
+    {
+        if (!uniformChanged(program, location, value, 2 * sizeof(float)))
+            return;
+        glUniform2fv(location, 1, value);
+    }
+    void uniform3fv(unsigned int program, int location, const float *value)
+    {
+        if (!uniformChanged(program, location, value, 3 * sizeof(float)))
+            return;
+        glUniform3fv(location, 1, value);
+    }
+    // count vec4s, for arrays starting at location. Arrays aren't filtered, only single values are.
+    void uniform4fv(unsigned int program, int location, const float *value, int count = 1)
+    {
+        if (count > 1 && location >= 0)
+        {
+            issued[Uniform]++;
+            forgetUniforms(program, location, count);
+            glUniform4fv(location, count, value);
+            return;
+        }
+        if (!uniformChanged(program, location, value, 4 * sizeof(float)))
+            return;
+        glUniform4fv(location, 1, value);
+    }
+    void uniform4iv(unsigned int program, int location, const int *value)
+    {
+        if (!uniformChanged(program, location, value, 4 * sizeof(int)))
+            return;
+        glUniform4iv(location, 1, value);
+    }
+    void uniformMatrix3fv(unsigned int program, int location, const float *value)
+    {
+        if (!uniformChanged(program, location, value, 9 * sizeof(float)))
+            return;
+        glUniformMatrix3fv(location, 1, GL_FALSE, value);
+    }
+    void uniformMatrix4fv(unsigned int program, int location, const float *value)
+    {
+        if (!uniformChanged(program, location, value, 16 * sizeof(float)))
+            return;
+        glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    }
+
+    // a deleted object must not be considered bound anymore (names get reused)
+    void forgetProgram(unsigned int program)
+    {
+        uniformValues.erase(program);
+        if (currentProgram == program)
+            currentProgram = 0;
+    }
+    void forgetTexture(unsigned int texture)
+    {
+        for (unsigned int unit = 0; unit < MAX_UNITS; unit++)
+            for (unsigned int slot = 0; slot < TARGET_SLOTS; slot++)
+                if (boundTextures[unit][slot] == texture)
+                    boundTextures[unit][slot] = 0;
+    }
+    void forgetVertexArray(unsigned int vao)
+    {
+        if (currentVertexArray == vao)
+            currentVertexArray = 0;
+    }
+    void forgetFramebuffer(unsigned int framebuffer)
+    {
+        if (currentFramebuffer == framebuffer)
+            currentFramebuffer = 0;
+    }
+
+    // forgets everything, the next call of each kind is issued unconditionally
+    void invalidate()
+    {
+        currentProgram = currentVertexArray = currentFramebuffer = UNKNOWN;
+        currentUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_UNITS; unit++)
+            for (unsigned int slot = 0; slot < TARGET_SLOTS; slot++)
+                boundTextures[unit][slot] = UNKNOWN;
+        currentViewport[0] = currentViewport[1] = currentViewport[2] = currentViewport[3] = -1;
+        uniformValues.clear();
+    }
+
+    void resetCounters()
+    {
+        memset(issued, 0, sizeof(issued));
+        memset(elided, 0, sizeof(elided));
+    }
+
+    void printCounters(const char *label) const
+    {
+        static const char *names[KindCount] = {"program", "vao", "active texture", "texture", "framebuffer", "viewport", "uniform"};
+        unsigned long long totalIssued = 0, totalElided = 0;
+        cout << "GL_STATE:: " << label << ":";
+        for (int kind = 0; kind < KindCount; kind++)
+        {
+            cout << " " << names[kind] << " " << issued[kind] << "/" << issued[kind] + elided[kind];
+            totalIssued += issued[kind];
+            totalElided += elided[kind];
+        }
+        cout << " | issued " << totalIssued << ", elided " << totalElided << endl;
+    }
+
+private:
+    static const unsigned int MAX_UNITS = 32;
+    static const unsigned int TARGET_SLOTS = 4;
+    static const unsigned int UNKNOWN = 0xffffffffu;
+
+    // uniform values up to a mat4, per location
+    struct UniformValue {
+        unsigned int size = 0;
+        unsigned char bytes[64];
+    };
+
+    unsigned int currentProgram = 0;
+    unsigned int currentVertexArray = 0;
+    unsigned int currentUnit = 0;
+    unsigned int currentFramebuffer = 0;
+    int currentViewport[4] = {-1, -1, -1, -1};
+    unsigned int boundTextures[MAX_UNITS][TARGET_SLOTS] = {};
+    unordered_map<unsigned int, vector<UniformValue>> uniformValues;
+
+    GLState() {}
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    // counts the call, returns true if it can be dropped
+    bool skip(CallKind kind, bool redundant)
+    {
+        if (enabled && redundant)
+        {
+            elided[kind]++;
+            return true;
+        }
+        issued[kind]++;
+        return false;
+    }
+
+    // array elements get consecutive locations, a write of count elements makes all of them unknown
+    void forgetUniforms(unsigned int program, int location, int count)
+    {
+        auto it = uniformValues.find(program);
+        if (it == uniformValues.end())
+            return;
+        for (int i = location; i < location + count && (size_t)i < it->second.size(); i++)
+            it->second[i].size = 0;
+    }
+
+    bool uniformChanged(unsigned int program, int location, const void *value, unsigned int size)
+    {
+        if (location < 0)
+            return false; // glUniform* ignores -1 anyway
+        if (!enabled)
+        {
+            issued[Uniform]++;
+            return true;
+        }
+        vector<UniformValue> &values = uniformValues[program];
+        if ((size_t)location >= values.size())
+            values.resize(location + 1);
+        UniformValue &cached = values[location];
+        if (skip(Uniform, cached.size == size && memcmp(cached.bytes, value, size) == 0))
+            return false;
+        cached.size = size;
+        memcpy(cached.bytes, value, size);
+        return true;
+    }
+
+    static int targetSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:       return 0;
+        case GL_TEXTURE_CUBE_MAP: return 1;
+        case GL_TEXTURE_2D_ARRAY: return 2;
+        case GL_TEXTURE_BUFFER:   return 3;
+        default:                  return -1;
+        }
+    }
+};
+#endif
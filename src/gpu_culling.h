@@ -0,0 +1,190 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "gpu_resource.h"
+#include "mesh.h"
+#include "shader.h"
+
+using namespace std;
+
+// Culls instance records on the GPU. A pass with rasterizer discard draws the source records as points through a
+// transform feedback program (see Space_Animation/shaders/asteroid_cull.*) whose geometry stage emits only the
+// visible ones, so the survivors end up packed in a destination buffer without the CPU ever touching them.
+//
+// The number of survivors comes from a GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query. With ARB_query_buffer_object
+// and ARB_draw_indirect the GPU writes it straight into the instance count of an indirect draw. Without them the
+// destination is double buffered and each frame draws the previous frame's survivors with the count of its query,
+// which is ready by then; visibility lags one frame behind, which is invisible unless the camera turns fast.
+class TransformFeedbackCuller {
+public:
+    // vertex array the cull pass reads the source records through, the caller points its attributes at them
+    unsigned int sourceVertexArray;
+    // true if the draw count never travels through the CPU
+    bool indirect;
+    // survivors and GPU time of the cull pass, read back without waiting so they trail by a frame or two
+    unsigned int visibleCount = 0;
+    double gpuMs = 0.0;
+
+    TransformFeedbackCuller(size_t recordSize, unsigned int capacity)
+    {
+        GLExtensions &ext = glExtensions();
+        indirect = ext.drawIndirect && ext.queryBuffer;
+
+        sourceArray = GpuVertexArray::create();
+        sourceVertexArray = sourceArray.id();
+        for (int i = 0; i < 2; i++)
+        {
+            destinationBuffers[i] = GpuBuffer::create();
+            primitivesQueryObjects[i] = GpuQuery::create();
+            timerQueryObjects[i] = GpuQuery::create();
+            destination[i] = destinationBuffers[i].id();
+            primitivesQueries[i] = primitivesQueryObjects[i].id();
+            timerQueries[i] = timerQueryObjects[i].id();
+        }
+        for (int i = 0; i < (indirect ? 1 : 2); i++)
+        {
+            destinationBuffers[i].setBytes(recordSize * capacity);
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, destination[i]);
+            glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, recordSize * capacity, NULL, GL_DYNAMIC_COPY);
+        }
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+
+        if (indirect)
+        {
+            commandBuffer = GpuBuffer::create(MAX_DRAWS * sizeof(DrawElementsIndirectCommand));
+            commands = commandBuffer.id();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_DRAWS * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    TransformFeedbackCuller(const TransformFeedbackCuller&) = delete;
+    TransformFeedbackCuller& operator=(const TransformFeedbackCuller&) = delete;
+
+    // runs cullShader over the first count source records; its uniforms (frustum, ...) must be set already
+    void cull(Shader &cullShader, unsigned int count)
+    {
+        readResults();
+        frame++;
+        drawIndex = 0;
+        unsigned int current = indirect ? 0 : frame & 1;
+
+        GLState &gl = GLState::instance();
+        cullShader.use();
+        gl.bindVertexArray(sourceVertexArray);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, destination[current]);
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[frame & 1]);
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, primitivesQueries[current]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        glEndQuery(GL_TIME_ELAPSED);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        pending[current] = true;
+        timerPending[frame & 1] = true;
+    }
+
+    // buffer the survivors drawn this frame are read from, point the meshes' instance attributes at it
+    unsigned int instanceBuffer() const
+    {
+        return indirect ? destination[0] : destination[(frame - 1) & 1];
+    }
+
+    // draws mesh (with whatever material is bound) once per survivor
+    void draw(const Mesh &mesh)
+    {
+        GLState::instance().bindVertexArray(mesh.VAO);
+        unsigned int segmentCount = mesh.lodSegments[1] - mesh.lodSegments[0];
+        if (indirect && drawIndex + segmentCount <= MAX_DRAWS)
+        {
+            // the count goes query -> command buffer -> draw without leaving the GPU, one command per index segment
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+            glBindBuffer(GL_QUERY_BUFFER, commands);
+            for (unsigned int s = mesh.lodSegments[0]; s < mesh.lodSegments[1]; s++)
+            {
+                const MeshIndexSegment &segment = mesh.segments[s];
+                DrawElementsIndirectCommand command = {segment.indexCount, 0, mesh.arenaFirstIndex(segment), mesh.arenaBaseVertex(segment), 0};
+                GLintptr offset = drawIndex * sizeof(DrawElementsIndirectCommand);
+                glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset, sizeof(command), &command);
+                glGetQueryObjectuiv(primitivesQueries[0], GL_QUERY_RESULT,
+                                    (GLuint*)(offset + offsetof(DrawElementsIndirectCommand, instanceCount)));
+                glExtensions().DrawElementsIndirect(GL_TRIANGLES, mesh.indexType, (const void*)offset);
+                drawIndex++;
+            }
+            glBindBuffer(GL_QUERY_BUFFER, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else if (!indirect)
+        {
+            unsigned int previous = (frame - 1) & 1;
+            if (frame < 2)
+                return;
+            if (pending[previous])
+            {
+                // a frame old, normally ready; waits otherwise
+                glGetQueryObjectuiv(primitivesQueries[previous], GL_QUERY_RESULT, &previousCount);
+                pending[previous] = false;
+                visibleCount = previousCount;
+            }
+            if (previousCount > 0)
+                mesh.drawElements(previousCount);
+        }
+    }
+
+private:
+    static const unsigned int MAX_DRAWS = 64;
+
+    // the names below are owned by these handles
+    GpuVertexArray sourceArray;
+    GpuBuffer destinationBuffers[2];
+    GpuQuery primitivesQueryObjects[2];
+    GpuQuery timerQueryObjects[2];
+    GpuBuffer commandBuffer;
+    unsigned int destination[2];
+    unsigned int primitivesQueries[2];
+    unsigned int timerQueries[2];
+    bool pending[2] = {false, false};
+    bool timerPending[2] = {false, false};
+    unsigned int commands = 0;
+    unsigned int drawIndex = 0;
+    unsigned int frame = 0;
+    unsigned int previousCount = 0;
+
+    // collects finished query results without stalling
+    void readResults()
+    {
+        GLuint available = 0;
+        if (indirect && pending[0])
+        {
+            glGetQueryObjectuiv(primitivesQueries[0], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                glGetQueryObjectuiv(primitivesQueries[0], GL_QUERY_RESULT, &visibleCount);
+                pending[0] = false;
+            }
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (!timerPending[i])
+                continue;
+            glGetQueryObjectuiv(timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(timerQueries[i], GL_QUERY_RESULT, &nanoseconds);
+            gpuMs = nanoseconds / 1.0e6;
+            timerPending[i] = false;
+        }
+    }
+};
+#endif
@@ -0,0 +1,303 @@
+#ifndef GPU_RESOURCE_H
+#define GPU_RESOURCE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+#include "gl_state.h"
+
+using namespace std;
+
+enum class GpuResourceType : uint8_t { Buffer, Texture, VertexArray, Framebuffer, Renderbuffer, Program, Query, Count };
+
+// slot of the GpuResourcePool plus the generation the slot had when the object was put there. The generation moves on
+// when the object is destroyed, so a stale handle is told apart from the slot's next object with one comparison.
+struct GpuHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0; // 0: no object
+};
+
+// Owns the GL objects behind GpuResource handles, in slots that are reused through a free list. Keeps the number of
+// live objects and the bytes they were declared to hold per type.
+//
+// Destroying an object doesn't delete it right away: it waits until collect() has put a fence behind every command
+// issued so far and the GPU has passed that fence, so nothing still in flight can refer to a deleted name. Call
+// collect() once per frame after swapping buffers to have objects deleted a frame or two after they're destroyed.
+// Code that doesn't still can't pile up destroyed objects while it keeps creating new ones: adopt() collects first
+// once autoCollectCount of them are waiting (destroy() doesn't, it may run from static destructors after the context
+// is gone). destroyAll() deletes everything at once, live objects included, and has to run while the context still
+// exists; handles outliving it are stale and do nothing.
+class GpuResourcePool {
+public:
+    // destroyed objects left waiting for a fence before adopt() calls collect() itself
+    size_t autoCollectCount = 16;
+
+    static GpuResourcePool& instance()
+    {
+        // never destroyed: handles in static storage may well be destroyed after it
+        static GpuResourcePool *pool = new GpuResourcePool();
+        return *pool;
+    }
+
+    // takes ownership of name, an object of type
+    GpuHandle adopt(GpuResourceType type, GLuint name, size_t bytes = 0)
+    {
+        // objects are only created while the context is current, a safe point to catch up for code not calling collect()
+        if (destroyed.size() >= autoCollectCount)
+            collect();
+        uint32_t index;
+        if (!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            index = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        }
+        Slot &slot = slots[index];
+        slot.name = name;
+        slot.type = type;
+        slot.bytes = bytes;
+        slot.live = true;
+        liveObjects[(int)type]++;
+        liveBytes[(int)type] += bytes;
+        GpuHandle handle;
+        handle.index = index;
+        handle.generation = slot.generation;
+        return handle;
+    }
+
+    bool valid(GpuHandle handle) const
+    {
+        return handle.generation != 0 && handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+
+    // GL name of the object, 0 for a stale or empty handle
+    GLuint name(GpuHandle handle) const { return valid(handle) ? slots[handle.index].name : 0; }
+
+    void setBytes(GpuHandle handle, size_t bytes)
+    {
+        if (!valid(handle))
+            return;
+        Slot &slot = slots[handle.index];
+        liveBytes[(int)slot.type] += bytes - slot.bytes;
+        slot.bytes = bytes;
+    }
+
+    // frees the slot now and queues the object for deletion once the GPU is done with it, stale handles are ignored
+    void destroy(GpuHandle handle)
+    {
+        if (!valid(handle))
+            return;
+        Slot &slot = slots[handle.index];
+        destroyed.push_back(PendingObject{slot.type, slot.name});
+        release(handle.index);
+    }
+
+    // fences the objects destroyed since the last call and deletes those whose fence the GPU has passed
+    void collect()
+    {
+        if (!destroyed.empty())
+        {
+            PendingBatch batch;
+            batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            batch.objects.swap(destroyed);
+            fenced.push_back(std::move(batch));
+        }
+        // fences are passed in order, the first one not signaled ends the search
+        while (!fenced.empty())
+        {
+            GLenum status = glClientWaitSync(fenced.front().fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            deleteBatch(fenced.front());
+            fenced.pop_front();
+        }
+    }
+
+    // deletes every object, live or pending, without waiting for the GPU (deleting is safe in GL, it only frees early)
+    void destroyAll()
+    {
+        for (uint32_t index = 0; index < slots.size(); index++)
+            if (slots[index].live)
+            {
+                deleteObject(slots[index].type, slots[index].name);
+                release(index);
+            }
+        for (const PendingObject &object : destroyed)
+            deleteObject(object.type, object.name);
+        destroyed.clear();
+        for (PendingBatch &batch : fenced)
+            deleteBatch(batch);
+        fenced.clear();
+    }
+
+    size_t liveCount(GpuResourceType type) const { return liveObjects[(int)type]; }
+    size_t liveByteCount(GpuResourceType type) const { return liveBytes[(int)type]; }
+    size_t pendingCount() const
+    {
+        size_t count = destroyed.size();
+        for (const PendingBatch &batch : fenced)
+            count += batch.objects.size();
+        return count;
+    }
+
+    void printStats() const
+    {
+        static const char *names[(int)GpuResourceType::Count] = {"buffers", "textures", "vertex arrays", "framebuffers",
+                                                                  "renderbuffers", "programs", "queries"};
+        cout << "GPU_RESOURCES::";
+        for (int type = 0; type < (int)GpuResourceType::Count; type++)
+        {
+            cout << " " << liveObjects[type] << " " << names[type];
+            if (liveBytes[type] > 0)
+                cout << " (" << liveBytes[type] / 1024 << " KiB)";
+            cout << (type + 1 < (int)GpuResourceType::Count ? "," : "");
+        }
+        cout << " | " << pendingCount() << " awaiting deletion, " << slots.size() << " slots" << endl;
+    }
+
+private:
+    struct Slot {
+        GLuint name = 0;
+        uint32_t generation = 1;
+        GpuResourceType type = GpuResourceType::Buffer;
+        bool live = false;
+        size_t bytes = 0;
+    };
+    struct PendingObject {
+        GpuResourceType type;
+        GLuint name;
+    };
+    struct PendingBatch {
+        GLsync fence = 0;
+        vector<PendingObject> objects;
+    };
+
+    vector<Slot> slots;
+    vector<uint32_t> freeSlots;
+    vector<PendingObject> destroyed; // not fenced yet
+    deque<PendingBatch> fenced;
+    size_t liveObjects[(int)GpuResourceType::Count] = {};
+    size_t liveBytes[(int)GpuResourceType::Count] = {};
+
+    GpuResourcePool() {}
+    GpuResourcePool(const GpuResourcePool&) = delete;
+    GpuResourcePool& operator=(const GpuResourcePool&) = delete;
+
+    void release(uint32_t index)
+    {
+        Slot &slot = slots[index];
+        liveObjects[(int)slot.type]--;
+        liveBytes[(int)slot.type] -= slot.bytes;
+        slot.live = false;
+        slot.name = 0;
+        slot.bytes = 0;
+        if (++slot.generation == 0)
+            slot.generation = 1;
+        freeSlots.push_back(index);
+    }
+
+    static void deleteBatch(PendingBatch &batch)
+    {
+        for (const PendingObject &object : batch.objects)
+            deleteObject(object.type, object.name);
+        glDeleteSync(batch.fence);
+    }
+
+    static void deleteObject(GpuResourceType type, GLuint name)
+    {
+        GLState &gl = GLState::instance();
+        switch (type)
+        {
+        case GpuResourceType::Buffer:       glDeleteBuffers(1, &name); break;
+        case GpuResourceType::Texture:      gl.forgetTexture(name); glDeleteTextures(1, &name); break;
+        case GpuResourceType::VertexArray:  gl.forgetVertexArray(name); glDeleteVertexArrays(1, &name); break;
+        case GpuResourceType::Framebuffer:  gl.forgetFramebuffer(name); glDeleteFramebuffers(1, &name); break;
+        case GpuResourceType::Renderbuffer: glDeleteRenderbuffers(1, &name); break;
+        case GpuResourceType::Program:      gl.forgetProgram(name); glDeleteProgram(name); break;
+        case GpuResourceType::Query:        glDeleteQueries(1, &name); break;
+        default: break;
+        }
+    }
+};
+
+// Move-only owner of one GL object of Type, kept in the GpuResourcePool: destroying or overwriting the handle hands the
+// object to the pool's deferred deletion. id() looks the name up through the slot, 0 once the object is gone.
+template<GpuResourceType Type>
+class GpuResource {
+public:
+    GpuResource() {}
+    // takes ownership of an existing object, bytes is what it holds for the pool's statistics
+    explicit GpuResource(GLuint name, size_t bytes = 0)
+    {
+        if (name)
+            handle = GpuResourcePool::instance().adopt(Type, name, bytes);
+    }
+
+    // generates a new object
+    static GpuResource create(size_t bytes = 0) { return GpuResource(generate(), bytes); }
+
+    GpuResource(GpuResource &&other) noexcept : handle(other.handle) { other.handle = GpuHandle(); }
+    GpuResource& operator=(GpuResource &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            handle = other.handle;
+            other.handle = GpuHandle();
+        }
+        return *this;
+    }
+    GpuResource(const GpuResource&) = delete;
+    GpuResource& operator=(const GpuResource&) = delete;
+
+    ~GpuResource() { reset(); }
+
+    GLuint id() const { return GpuResourcePool::instance().name(handle); }
+    explicit operator bool() const { return GpuResourcePool::instance().valid(handle); }
+
+    void setBytes(size_t bytes) { GpuResourcePool::instance().setBytes(handle, bytes); }
+
+    // destroys the object now (deleted once the GPU is done with it), the handle is empty afterwards
+    void reset()
+    {
+        GpuResourcePool::instance().destroy(handle);
+        handle = GpuHandle();
+    }
+
+private:
+    GpuHandle handle;
+
+    static GLuint generate()
+    {
+        GLuint name = 0;
+        switch (Type)
+        {
+        case GpuResourceType::Buffer:       glGenBuffers(1, &name); break;
+        case GpuResourceType::Texture:      glGenTextures(1, &name); break;
+        case GpuResourceType::VertexArray:  glGenVertexArrays(1, &name); break;
+        case GpuResourceType::Framebuffer:  glGenFramebuffers(1, &name); break;
+        case GpuResourceType::Renderbuffer: glGenRenderbuffers(1, &name); break;
+        case GpuResourceType::Program:      name = glCreateProgram(); break;
+        case GpuResourceType::Query:        glGenQueries(1, &name); break;
+        default: break;
+        }
+        return name;
+    }
+};
+
+typedef GpuResource<GpuResourceType::Buffer>       GpuBuffer;
+typedef GpuResource<GpuResourceType::Texture>      GpuTexture;
+typedef GpuResource<GpuResourceType::VertexArray>  GpuVertexArray;
+typedef GpuResource<GpuResourceType::Framebuffer>  GpuFramebuffer;
+typedef GpuResource<GpuResourceType::Renderbuffer> GpuRenderbuffer;
+typedef GpuResource<GpuResourceType::Program>      GpuProgram;
+typedef GpuResource<GpuResourceType::Query>        GpuQuery;
+#endif
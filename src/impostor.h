@@ -0,0 +1,214 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include <iostream>
+
+#include "gl_state.h"
+#include "gpu_resource.h"
+#include "model.h"
+#include "shader.h"
+
+using namespace std;
+
+// Octahedral impostor of a model: the model is pre-rendered from framesPerSide x framesPerSide directions spread
+// over the whole sphere into one atlas, the frame of direction d sitting in the cell octEncode(d) falls into. Far
+// away instances are then drawn as a single quad showing the frame closest to their (object space) view direction.
+//
+// Every frame is an orthographic view of the model's bounding sphere along its direction, with the up vector of
+// frameBasis(); the quad of an instance is built in the same basis, so the frame lines up with it exactly. Besides
+// the albedo (alpha = coverage) the atlas keeps object space normals, so the impostors are lit like the meshes.
+// See Space_Animation/shaders/impostor.* for the drawing side, which repeats the mapping in GLSL.
+class ImpostorAtlas {
+public:
+    unsigned int framesPerSide;
+    unsigned int frameSize;
+    // atlas textures, RGBA8: albedo with coverage, and object space normals mapped to [0, 1]
+    unsigned int albedo = 0;
+    unsigned int normals = 0;
+    // unit quad (corners in [-1, 1]) at location 0, the caller points the instance attributes of this VAO at its data
+    unsigned int vertexArray = 0;
+    // bounding sphere of the model the frames were rendered around
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 1.0f;
+
+    ImpostorAtlas(unsigned int framesPerSide = 8, unsigned int frameSize = 128)
+        : framesPerSide(framesPerSide), frameSize(frameSize)
+    {
+        GLState &gl = GLState::instance();
+        unsigned int size = framesPerSide * frameSize;
+        GpuTexture *targets[2] = {&albedoTexture, &normalTexture};
+        for (GpuTexture *texture : targets)
+        {
+            *texture = GpuTexture::create((size_t)size * size * 4 * 4 / 3);
+            gl.bindTexture(GL_TEXTURE_2D, texture->id());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            // deeper levels would blend neighbouring frames together
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max(0, (int)log2((float)frameSize) - 3));
+        }
+
+        albedo = albedoTexture.id();
+        normals = normalTexture.id();
+
+        float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+        quadArray = GpuVertexArray::create();
+        quadBuffer = GpuBuffer::create(sizeof(corners));
+        vertexArray = quadArray.id();
+        gl.bindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, quadBuffer.id());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        gl.bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    // renders every frame of model (all meshes at full detail) around the sphere (sphereCenter, sphereRadius) with
+    // bakeShader, which writes albedo to output 0 and the normal to output 1 from "view" and "projection" uniforms.
+    // Leaves the framebuffer binding, viewport, clear color, blending and depth test as it found them.
+    void bake(Model &model, Shader &bakeShader, const glm::vec3 &sphereCenter, float sphereRadius)
+    {
+        center = sphereCenter;
+        radius = sphereRadius;
+        GLState &gl = GLState::instance();
+        GLint previousFramebuffer = 0, previousViewport[4];
+        GLfloat previousClearColor[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColor);
+
+        // only needed while baking, they go back to the pool on return
+        unsigned int size = framesPerSide * frameSize;
+        GpuFramebuffer framebuffer = GpuFramebuffer::create();
+        GpuRenderbuffer depth = GpuRenderbuffer::create((size_t)size * size * 4);
+        gl.bindFramebuffer(framebuffer.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normals, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth.id());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth.id());
+        GLenum attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::IMPOSTOR:: Framebuffer is not complete!" << endl;
+
+        GLboolean blending = glIsEnabled(GL_BLEND), depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        gl.viewport(0, 0, size, size);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // the eye sits a radius outside the sphere, the depth range covers it whole
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+        bakeShader.use();
+        bakeShader.setMat4f("projection"_uniform, glm::value_ptr(projection));
+        for (unsigned int y = 0; y < framesPerSide; y++)
+            for (unsigned int x = 0; x < framesPerSide; x++)
+            {
+                glm::vec3 direction = frameDirection(x, y);
+                glm::vec3 right, up;
+                frameBasis(direction, right, up);
+                glm::mat4 view = glm::lookAt(center + direction * (2.0f * radius), center, up);
+                gl.viewport(x * frameSize, y * frameSize, frameSize, frameSize);
+                bakeShader.setMat4f("view"_uniform, glm::value_ptr(view));
+                model.Draw(bakeShader);
+            }
+
+        gl.bindFramebuffer(previousFramebuffer);
+        gl.viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        glClearColor(previousClearColor[0], previousClearColor[1], previousClearColor[2], previousClearColor[3]);
+        if (blending)
+            glEnable(GL_BLEND);
+        if (!depthTest)
+            glDisable(GL_DEPTH_TEST);
+
+        for (unsigned int texture : {albedo, normals})
+        {
+            gl.bindTexture(GL_TEXTURE_2D, texture);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        cout << "IMPOSTOR:: baked " << framesPerSide * framesPerSide << " frames of " << frameSize << "x" << frameSize
+             << " into a " << size << "x" << size << " atlas" << endl;
+    }
+
+    // binds the atlases to units firstUnit and firstUnit + 1 and sets the impostor shader's uniforms
+    void bind(Shader &shader, unsigned int firstUnit) const
+    {
+        GLState &gl = GLState::instance();
+        gl.bindTextureUnit(firstUnit, GL_TEXTURE_2D, albedo);
+        gl.bindTextureUnit(firstUnit + 1, GL_TEXTURE_2D, normals);
+        shader.setInt("impostorAlbedo"_uniform, (int)firstUnit);
+        shader.setInt("impostorNormals"_uniform, (int)firstUnit + 1);
+        shader.setFloat("framesPerSide"_uniform, (float)framesPerSide);
+        shader.setVec4("impostorSphere"_uniform, glm::value_ptr(glm::vec4(center, radius)));
+    }
+
+    // draws instanceCount quads from vertexArray, whose instance attributes the caller set up
+    void draw(unsigned int instanceCount) const
+    {
+        GLState::instance().bindVertexArray(vertexArray);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+    }
+
+    // unit direction the frame in cell (x, y) was rendered from, looking back at the center
+    glm::vec3 frameDirection(unsigned int x, unsigned int y) const
+    {
+        glm::vec2 p = (glm::vec2(x, y) + 0.5f) / (float)framesPerSide * 2.0f - 1.0f;
+        return octDecode(p);
+    }
+
+    // octahedral mapping of the unit sphere onto [-1, 1]^2, the upper hemisphere (y > 0) in the inner diamond
+    static glm::vec2 octEncode(glm::vec3 n)
+    {
+        n /= fabs(n.x) + fabs(n.y) + fabs(n.z);
+        glm::vec2 p(n.x, n.z);
+        if (n.y < 0.0f)
+            p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(p);
+        return p;
+    }
+    static glm::vec3 octDecode(glm::vec2 p)
+    {
+        glm::vec3 n(p.x, 1.0f - fabs(p.x) - fabs(p.y), p.y);
+        if (n.y < 0.0f)
+        {
+            glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.z, n.x))) * signNotZero(glm::vec2(n.x, n.z));
+            n.x = folded.x;
+            n.z = folded.y;
+        }
+        return glm::normalize(n);
+    }
+
+    // right and up of a frame looking along -direction (as glm::lookAt builds them)
+    static void frameBasis(const glm::vec3 &direction, glm::vec3 &right, glm::vec3 &up)
+    {
+        glm::vec3 reference = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        right = glm::normalize(glm::cross(-direction, reference));
+        up = glm::cross(right, -direction);
+    }
+
+private:
+    // own albedo, normals and vertexArray
+    GpuTexture albedoTexture, normalTexture;
+    GpuVertexArray quadArray;
+    GpuBuffer quadBuffer;
+
+    static glm::vec2 signNotZero(const glm::vec2 &v)
+    {
+        return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+};
+#endif
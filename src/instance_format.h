@@ -0,0 +1,85 @@
+#ifndef INSTANCE_FORMAT_H
+#define INSTANCE_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-instance transforms restricted to translation, rotation and uniform scale, which is all instanced scenery
+// needs and lets the vertex shader transform normals with the rotation alone instead of an inverse transpose.
+// Both formats are a whole number of 16 byte words so passes that only move records around (GPU culling) can read
+// them as raw uvec4s.
+
+// 32 bytes, full precision
+struct CompactInstance {
+    glm::vec3 position;
+    float scale;
+    glm::vec4 rotation; // unit quaternion x, y, z, w
+
+    static const unsigned int WORDS = 2;
+
+    static CompactInstance make(const glm::vec3 &position, float scale, const glm::quat &rotation)
+    {
+        return CompactInstance{position, scale, glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w)};
+    }
+
+    // points attributes location (position, scale) and location + 1 (rotation) of the bound VAO at the bound buffer,
+    // starting with instance first
+    static void setupAttributes(unsigned int location, size_t first = 0)
+    {
+        size_t base = first * sizeof(CompactInstance);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(CompactInstance), (void*)base);
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location + 1);
+        glVertexAttribPointer(location + 1, 4, GL_FLOAT, GL_FALSE, sizeof(CompactInstance), (void*)(base + offsetof(CompactInstance, rotation)));
+        glVertexAttribDivisor(location + 1, 1);
+    }
+};
+
+// 16 bytes: position as unorm16 inside the bounds of the whole set (passed to the shader as uniforms), scale as a
+// half float, rotation as a snorm16 quaternion
+struct PackedInstance {
+    uint16_t position[3];
+    uint16_t scale;
+    int16_t rotation[4];
+
+    static const unsigned int WORDS = 1;
+
+    static PackedInstance pack(const CompactInstance &instance, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent)
+    {
+        PackedInstance packed;
+        glm::vec3 normalized = glm::clamp((instance.position - boundsMin) / glm::max(boundsExtent, glm::vec3(1e-6f)), 0.0f, 1.0f);
+        for (int i = 0; i < 3; i++)
+            packed.position[i] = (uint16_t)(normalized[i] * 65535.0f + 0.5f);
+        packed.scale = glm::packHalf1x16(instance.scale);
+        for (int i = 0; i < 4; i++)
+            packed.rotation[i] = (int16_t)glm::round(glm::clamp(instance.rotation[i], -1.0f, 1.0f) * 32767.0f);
+        return packed;
+    }
+
+    // points attributes location (position), location + 1 (scale) and location + 2 (rotation) of the bound VAO at
+    // the bound buffer, starting with instance first; the GL does the unorm/snorm/half conversion
+    static void setupAttributes(unsigned int location, size_t first = 0)
+    {
+        size_t base = first * sizeof(PackedInstance);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedInstance), (void*)base);
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location + 1);
+        glVertexAttribPointer(location + 1, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedInstance), (void*)(base + offsetof(PackedInstance, scale)));
+        glVertexAttribDivisor(location + 1, 1);
+        glEnableVertexAttribArray(location + 2);
+        glVertexAttribPointer(location + 2, 4, GL_SHORT, GL_TRUE, sizeof(PackedInstance), (void*)(base + offsetof(PackedInstance, rotation)));
+        glVertexAttribDivisor(location + 2, 1);
+    }
+};
+
+static_assert(sizeof(CompactInstance) == 32, "CompactInstance must stay two 16 byte words");
+static_assert(sizeof(PackedInstance) == 16, "PackedInstance must stay one 16 byte word");
+#endif
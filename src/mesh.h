@@ -6,30 +6,22 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "gl_state.h"
+#include "mesh_arena.h"
 #include "shader.h"
+#include "texture_array.h"
+#include "vertex_format.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
-	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
-};
+// render_queue.h
+class RenderQueue;
+enum class RenderPass : unsigned char;
 
 struct Texture {
     unsigned int id;
@@ -37,110 +29,411 @@ struct Texture {
     string path;
 };
 
+// a level of detail: a range of the mesh's index buffer, drawing the same vertices with fewer triangles
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    // largest distance (object space) between this level's surface and the full mesh's
+    float error;
+};
+
+// whether a mesh keeps its vertices and indices in CPU memory after uploading them, e.g. for collision or picking.
+// A mesh built from packed data (a mapped mesh cache) unpacks what it keeps from its VertexFormat: positions and
+// indices are the same as after an import, but attributes the format drops (bone data, the tangent frame of Basic)
+// are zero and quantized formats carry their quantization error.
+enum class MeshRetention { KeepCPU, DropAfterUpload };
+
+// a run of a level's indices drawn with one call; the indices are relative to baseVertex, which keeps the vertices of a
+// mesh with more than 65536 of them addressable with 16-bit indices
+struct MeshIndexSegment {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    int baseVertex;
+};
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
-    vector<unsigned int> indices;
+    vector<unsigned int> indices;       // every level of detail, one after the other
     vector<Texture>      textures;
-    unsigned int VAO;
+    unsigned int VAO = 0;  // of the arena page the mesh lives in, shared with the other meshes there
+    // number of indices of the full detail level, also valid when the mesh was uploaded without keeping CPU-side copies
+    unsigned int indexCount = 0;
+    // levels of detail from the full mesh (level 0, error 0) down, a single level unless the model generated a chain
+    vector<MeshLod> lods;
+    // which attributes of the vertices were uploaded, and for the quantized formats how to get the positions back
+    VertexFormat vertexFormat = VertexFormat::Basic;
+    PositionDecode positionDecode;
+    // type of the uploaded indices, GL_UNSIGNED_SHORT whenever the vertices can be addressed with it, else GL_UNSIGNED_INT
+    GLenum indexType = GL_UNSIGNED_INT;
+    // draw ranges of every level in level order, those of level l are [lodSegments[l], lodSegments[l + 1])
+    vector<MeshIndexSegment> segments;
+    vector<unsigned int> lodSegments;
+    // object space bounding box
+    glm::vec3 aabbMin = glm::vec3(0.0f);
+    glm::vec3 aabbMax = glm::vec3(0.0f);
+    // hash of the texture set and position decoding, meshes with equal hashes can be drawn without calling bindMaterial again
+    uint64_t materialHash = 0;
+    // when set, bindMaterial binds these arrays instead of textures and materialLayers says which layers to sample
+    const MaterialTextureArrays *textureArrays = nullptr;
+    glm::ivec4 materialLayers = glm::ivec4(-1);
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, lods index into indices; without lods all of indices is the only level. Pass the vectors with
+    // std::move, they're taken over rather than copied. Only the attributes of format are uploaded; with KeepCPU the
+    // CPU-side vertices stay complete, with DropAfterUpload vertices and indices are freed right after the upload.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<MeshLod> lods = vector<MeshLod>(),
+         VertexFormat format = VertexFormat::Skinned, MeshArena &arena = MeshArena::shared(),
+         MeshRetention retention = MeshRetention::KeepCPU)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        setLods(lods, this->indices.size());
+
+        if (!this->vertices.empty())
+        {
+            aabbMin = aabbMax = this->vertices[0].Position;
+            for (const Vertex &vertex : this->vertices)
+            {
+                aabbMin = glm::min(aabbMin, vertex.Position);
+                aabbMax = glm::max(aabbMax, vertex.Position);
+            }
+        }
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setPositionDecode(format);
+        vector<unsigned char> packed = packVertices(format, this->vertices.data(), this->vertices.size(), positionDecode);
+        setupMesh(arena, format, packed.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        hashMaterial();
+        if (retention == MeshRetention::DropAfterUpload)
+            dropCPUData();
     }
 
+    // constructor uploading straight from memory the mesh doesn't own (e.g. a mapped mesh cache), vertexData already
+    // packed in format. With DropAfterUpload vertices and indices stay empty, only indexCount and the bounds are kept;
+    // with KeepCPU they're copied out, the vertices unpacked from format.
+    Mesh(VertexFormat format, const void *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+         vector<Texture> textures, glm::vec3 aabbMin, glm::vec3 aabbMax, vector<MeshLod> lods = vector<MeshLod>(),
+         MeshArena &arena = MeshArena::shared(), MeshRetention retention = MeshRetention::DropAfterUpload)
+    {
+        this->textures = std::move(textures);
+        setLods(lods, indexCount);
+        this->aabbMin = aabbMin;
+        this->aabbMax = aabbMax;
+        setPositionDecode(format);
+
+        setupMesh(arena, format, vertexData, vertexCount, indexData, indexCount);
+        hashMaterial();
+        if (retention == MeshRetention::KeepCPU)
+        {
+            vertices = unpackVertices(format, vertexData, vertexCount, positionDecode);
+            indices.assign(indexData, indexData + indexCount);
+        }
+    }
+
+    // a mesh owns its range of the arena, so it can be moved (a moved-from mesh owns nothing) but not copied
+    Mesh(Mesh &&other) noexcept { swap(other); }
+    // what this mesh owned goes to other, and is released along with it
+    Mesh& operator=(Mesh &&other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    ~Mesh() { release(); }
+
     // render the mesh
     void Draw(Shader &shader) 
     {
+        bindMaterial(shader);
+        drawElements();
+
+        // with state tracking on, GLState knows what is bound and resetting it would only cost calls for the next
+        // draw to undo. Untracked code may still expect the defaults though.
+        GLState &gl = GLState::instance();
+        if (!gl.enabled)
+        {
+            gl.bindVertexArray(0);
+            gl.activeTexture(0);
+        }
+    }
+
+    // queue the mesh instead of drawing it right away, the opaque pass unless told otherwise (defined in render_queue.h)
+    void Draw(RenderQueue &queue, Shader &shader, const glm::mat4 &model) const;
+    void Draw(RenderQueue &queue, Shader &shader, const glm::mat4 &model, RenderPass pass, unsigned int instanceCount = 1) const;
+
+    // binds the textures to consecutive units and points the shader's samplers at them (or binds the texture arrays
+    // and sets materialLayers), and sets the shader's "positionOffset" and "positionScale" (if it has them) to decode
+    // quantized positions
+    void bindMaterial(Shader &shader) const
+    {
+        shader.setVec3("positionOffset"_uniform, &positionDecode.offset.x);
+        shader.setVec3("positionScale"_uniform, &positionDecode.scale.x);
+        if (textureArrays)
+        {
+            textureArrays->bind(shader, materialLayers);
+            return;
+        }
+
+        // sampler names by texture type and number, hashed at compile time so no names get built per draw
+        static const UniformId diffuseNames[]  = {"texture_diffuse1"_uniform, "texture_diffuse2"_uniform, "texture_diffuse3"_uniform, "texture_diffuse4"_uniform};
+        static const UniformId specularNames[] = {"texture_specular1"_uniform, "texture_specular2"_uniform, "texture_specular3"_uniform, "texture_specular4"_uniform};
+        static const UniformId normalNames[]   = {"texture_normal1"_uniform, "texture_normal2"_uniform, "texture_normal3"_uniform, "texture_normal4"_uniform};
+        static const UniformId heightNames[]   = {"texture_height1"_uniform, "texture_height2"_uniform, "texture_height3"_uniform, "texture_height4"_uniform};
+        const unsigned int maxPerType = 4;
+
         // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
+        unsigned int diffuseNr  = 0;
+        unsigned int specularNr = 0;
+        unsigned int normalNr   = 0;
+        unsigned int heightNr   = 0;
+        GLState &gl = GLState::instance();
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
+            // retrieve the sampler for this texture (the N in diffuse_textureN)
+            const string &name = textures[i].type;
+            int location = -1;
+            if(name == "texture_diffuse" && diffuseNr < maxPerType)
+                location = shader.getLocation(diffuseNames[diffuseNr++]);
+            else if(name == "texture_specular" && specularNr < maxPerType)
+                location = shader.getLocation(specularNames[specularNr++]);
+            else if(name == "texture_normal" && normalNr < maxPerType)
+                location = shader.getLocation(normalNames[normalNr++]);
+            else if(name == "texture_height" && heightNr < maxPerType)
+                location = shader.getLocation(heightNames[heightNr++]);
 
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            gl.uniform1i(shader.ID, location, i);
+            // and finally bind the texture to it
+            gl.bindTextureUnit(i, GL_TEXTURE_2D, textures[i].id);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // binds the VAO and draws level of detail lod, with whatever material is bound
+    void drawElements(unsigned int instanceCount = 1, unsigned int lod = 0) const
+    {
+        lod = (unsigned int)min<size_t>(lod, lods.size() - 1);
+        GLState::instance().bindVertexArray(VAO);
+        for (unsigned int s = lodSegments[lod]; s < lodSegments[lod + 1]; s++)
+        {
+            const MeshIndexSegment &segment = segments[s];
+            const void *offset = (const void*)((size_t)arenaFirstIndex(segment) * indexSize());
+            if (instanceCount == 1)
+                glDrawElementsBaseVertex(GL_TRIANGLES, segment.indexCount, indexType, offset, arenaBaseVertex(segment));
+            else
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, segment.indexCount, indexType, offset, instanceCount, arenaBaseVertex(segment));
+        }
+    }
+
+    // first index and base vertex of segment in the arena page's buffers, e.g. for indirect draw commands
+    unsigned int arenaFirstIndex(const MeshIndexSegment &segment) const
+    {
+        return (unsigned int)(allocation.indexOffset / indexSize()) + segment.firstIndex;
+    }
+    int arenaBaseVertex(const MeshIndexSegment &segment) const
+    {
+        return (int)(allocation.vertexOffset / vertexFormatSize(vertexFormat)) + segment.baseVertex;
+    }
+
+    // bytes per uploaded index
+    size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+    // bytes of index and vertex data the mesh takes in its arena
+    size_t indexBytes() const { return allocation.indexBytes; }
+    size_t vertexBytes() const { return allocation.vertexBytes; }
+
+    // samples the layers of arrays from now on, or the textures again for nullptr
+    void setTextureArrays(const MaterialTextureArrays *arrays, const glm::ivec4 &layers = glm::ivec4(-1))
+    {
+        textureArrays = arrays;
+        materialLayers = layers;
+        hashMaterial();
+    }
+
+    // frees the CPU-side vertices and indices; what drawing and culling need (bounds, counts, index ranges) stays
+    void dropCPUData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    // CPU memory held by the mesh, vertices and indices plus the bookkeeping that is always kept
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) + lods.capacity() * sizeof(MeshLod)
+             + segments.capacity() * sizeof(MeshIndexSegment) + lodSegments.capacity() * sizeof(unsigned int);
+    }
+
+    // gives the mesh's buffer ranges back to its arena early, the mesh can't be drawn afterwards. The destructor
+    // does this too.
+    void release()
+    {
+        if (arena)
+            arena->free(allocation);
+        arena = nullptr;
     }
 
 private:
     // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    MeshArena *arena = nullptr;
+    MeshAllocation allocation;
+
+    void swap(Mesh &other) noexcept
+    {
+        std::swap(vertices, other.vertices);
+        std::swap(indices, other.indices);
+        std::swap(textures, other.textures);
+        std::swap(VAO, other.VAO);
+        std::swap(indexCount, other.indexCount);
+        std::swap(lods, other.lods);
+        std::swap(vertexFormat, other.vertexFormat);
+        std::swap(positionDecode, other.positionDecode);
+        std::swap(indexType, other.indexType);
+        std::swap(segments, other.segments);
+        std::swap(lodSegments, other.lodSegments);
+        std::swap(aabbMin, other.aabbMin);
+        std::swap(aabbMax, other.aabbMax);
+        std::swap(materialHash, other.materialHash);
+        std::swap(textureArrays, other.textureArrays);
+        std::swap(materialLayers, other.materialLayers);
+        std::swap(arena, other.arena);
+        std::swap(allocation, other.allocation);
+    }
+
+    // a mesh split into more segments than this per level costs more in draw calls than it saves, it stays 32-bit
+    static const unsigned int MAX_SEGMENTS_PER_LOD = 8;
+
+    void setLods(const vector<MeshLod> &levels, size_t totalIndexCount)
+    {
+        lods = levels;
+        if (lods.empty())
+            lods.push_back(MeshLod{0, static_cast<unsigned int>(totalIndexCount), 0.0f});
+        indexCount = lods[0].indexCount;
+    }
+
+    void setPositionDecode(VertexFormat format)
+    {
+        positionDecode = vertexFormatQuantized(format) ? PositionDecode::fromBounds(aabbMin, aabbMax) : PositionDecode();
+    }
+
+    void hashMaterial()
+    {
+        // FNV-1a over type and id of every texture, in unit order (or the arrays and layers), then the position decoding
+        materialHash = 14695981039346656037ull;
+        auto mix = [&](uint64_t value)
+        {
+            for (int byte = 0; byte < 8; byte++)
+                materialHash = (materialHash ^ ((value >> (byte * 8)) & 0xff)) * 1099511628211ull;
+        };
+        if (textureArrays)
+        {
+            mix((uint64_t)(uintptr_t)textureArrays);
+            mix((uint64_t)(uint32_t)materialLayers.x << 32 | (uint32_t)materialLayers.y);
+            mix((uint64_t)(uint32_t)materialLayers.z << 32 | (uint32_t)materialLayers.w);
+        }
+        else
+            for (const Texture &texture : textures)
+                mix((uint64_t)uniformHash(texture.type.c_str()) << 32 | texture.id);
+        const unsigned char *decode = reinterpret_cast<const unsigned char*>(&positionDecode);
+        for (size_t byte = 0; byte < sizeof(PositionDecode); byte++)
+            materialHash = (materialHash ^ decode[byte]) * 1099511628211ull;
+    }
+
+    // picks the index type and cuts every level into segments drawable with it, returns true for 16-bit indices.
+    // A mesh of up to 65536 vertices gets one segment per level. A bigger one is cut into runs of triangles whose
+    // vertices span less than 65536 indices, which works out well since the import orders the vertices by first use.
+    // A single triangle spanning more than that (simplified levels join vertices placed far apart) can't be drawn with
+    // 16-bit indices at all, the mesh keeps 32-bit ones then.
+    bool buildSegments(size_t vertexCount, const unsigned int *indexData)
+    {
+        segments.clear();
+        lodSegments.assign(1, 0);
+        bool fits = vertexCount <= 65536;
+        bool worthwhile = true;
+        for (const MeshLod &level : lods)
+        {
+            if (!worthwhile)
+                break;
+            if (fits)
+            {
+                if (level.indexCount > 0)
+                    segments.push_back(MeshIndexSegment{level.firstIndex, level.indexCount, 0});
+            }
+            else
+            {
+                unsigned int start = level.firstIndex, end = level.firstIndex + level.indexCount;
+                unsigned int low = 0xffffffffu, high = 0;
+                for (unsigned int i = start; i < end; i += 3)
+                {
+                    unsigned int triangleLow = min(min(indexData[i], indexData[i + 1]), indexData[i + 2]);
+                    unsigned int triangleHigh = max(max(indexData[i], indexData[i + 1]), indexData[i + 2]);
+                    if (triangleHigh - triangleLow > 65535)
+                    {
+                        worthwhile = false;
+                        break;
+                    }
+                    if (i > start && max(high, triangleHigh) - min(low, triangleLow) > 65535)
+                    {
+                        segments.push_back(MeshIndexSegment{start, i - start, (int)low});
+                        start = i;
+                        low = 0xffffffffu;
+                        high = 0;
+                    }
+                    low = min(low, triangleLow);
+                    high = max(high, triangleHigh);
+                }
+                if (worthwhile && end > start)
+                    segments.push_back(MeshIndexSegment{start, end - start, (int)low});
+            }
+            lodSegments.push_back((unsigned int)segments.size());
+        }
+        for (size_t l = 0; worthwhile && l < lods.size(); l++)
+            if (lodSegments[l + 1] - lodSegments[l] > MAX_SEGMENTS_PER_LOD)
+                worthwhile = false;
+        if (worthwhile)
+        {
+            indexType = GL_UNSIGNED_SHORT;
+            return true;
+        }
+
+        // one 32-bit segment per level
+        segments.clear();
+        lodSegments.assign(1, 0);
+        for (const MeshLod &level : lods)
+        {
+            if (level.indexCount > 0)
+                segments.push_back(MeshIndexSegment{level.firstIndex, level.indexCount, 0});
+            lodSegments.push_back((unsigned int)segments.size());
+        }
+        indexType = GL_UNSIGNED_INT;
+        return false;
+    }
+
+    // uploads the vertices (packed in format) and the indices into the arena
+    void setupMesh(MeshArena &meshArena, VertexFormat format, const void *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
+    {
+        vertexFormat = format;
+        size_t vertexBytes = vertexCount * vertexFormatSize(format);
+        if (buildSegments(vertexCount, indexData))
+        {
+            // half the memory and fetch bandwidth of 32-bit indices
+            vector<uint16_t> shortIndices(indexCount);
+            for (const MeshIndexSegment &segment : segments)
+                for (unsigned int i = segment.firstIndex; i < segment.firstIndex + segment.indexCount; i++)
+                {
+                    // buildSegments only cuts segments within the 16-bit range, anything else would draw garbage
+                    assert(indexData[i] >= (unsigned int)segment.baseVertex && indexData[i] - segment.baseVertex <= 65535);
+                    shortIndices[i] = (uint16_t)(indexData[i] - segment.baseVertex);
+                }
+            allocation = meshArena.allocate(format, vertexData, vertexBytes, shortIndices.data(), indexCount * sizeof(uint16_t), sizeof(uint16_t));
+        }
+        else
+            allocation = meshArena.allocate(format, vertexData, vertexBytes, indexData, indexCount * sizeof(unsigned int), sizeof(unsigned int));
+        arena = &meshArena;
+        VAO = allocation.page->vertexArray.id();
     }
 };
 #endif
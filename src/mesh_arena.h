@@ -0,0 +1,218 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_resource.h"
+#include "vertex_format.h"
+
+using namespace std;
+
+// first fit suballocator of the byte range [0, capacity), neighbouring free ranges are merged on free
+class RangeAllocator {
+public:
+    size_t capacity = 0;
+    size_t used = 0;
+
+    explicit RangeAllocator(size_t capacity = 0) : capacity(capacity)
+    {
+        if (capacity > 0)
+            freeRanges[0] = capacity;
+    }
+
+    // finds size bytes starting at a multiple of alignment (any positive value, e.g. a vertex stride)
+    bool allocate(size_t size, size_t alignment, size_t &offset)
+    {
+        if (size == 0)
+        {
+            offset = 0;
+            return true;
+        }
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            size_t start = (it->first + alignment - 1) / alignment * alignment;
+            size_t end = it->first + it->second;
+            if (start + size > end)
+                continue;
+            size_t rangeStart = it->first;
+            freeRanges.erase(it);
+            // what's left before and after the allocation stays free
+            if (start > rangeStart)
+                freeRanges[rangeStart] = start - rangeStart;
+            if (end > start + size)
+                freeRanges[start + size] = end - (start + size);
+            offset = start;
+            used += size;
+            return true;
+        }
+        return false;
+    }
+
+    void free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        used -= size;
+        auto it = freeRanges.emplace(offset, size).first;
+        auto next = std::next(it);
+        if (next != freeRanges.end() && offset + it->second == next->first)
+        {
+            it->second += next->second;
+            freeRanges.erase(next);
+        }
+        if (it != freeRanges.begin())
+        {
+            auto previous = std::prev(it);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += it->second;
+                freeRanges.erase(it);
+            }
+        }
+    }
+
+private:
+    map<size_t, size_t> freeRanges;  // offset -> size
+};
+
+// one VAO over a vertex buffer and an index buffer that the meshes of one vertex format are suballocated from
+struct MeshArenaPage {
+    VertexFormat format;
+    GpuVertexArray vertexArray;
+    GpuBuffer vertexBuffer;
+    GpuBuffer indexBuffer;
+    RangeAllocator vertices;
+    RangeAllocator indices;
+};
+
+// where a mesh's data went: bytes of its page's buffers
+struct MeshAllocation {
+    MeshArenaPage *page = nullptr;
+    size_t vertexOffset = 0, vertexBytes = 0;
+    size_t indexOffset = 0, indexBytes = 0;
+};
+
+// Packs the vertex and index data of many meshes into few large buffers. Meshes of the same vertex format share a
+// page, so they share a VAO: drawing one after the other binds nothing, and each mesh is just an index range drawn
+// with a base vertex (its vertex offset divided by the stride). A page is created when no existing one has room, at
+// least pageVertexBytes / pageIndexBytes big, and deleted when its last mesh is freed.
+//
+// shared() is used by every Model unless given another arena, e.g. to keep per-instance attributes that are pointed
+// at a model's VAO away from the other models.
+class MeshArena {
+public:
+    size_t pageVertexBytes = 32 << 20;
+    size_t pageIndexBytes = 16 << 20;
+
+    static MeshArena& shared()
+    {
+        static MeshArena arena;
+        return arena;
+    }
+
+    MeshArena() {}
+    MeshArena(const MeshArena&) = delete;
+    MeshArena& operator=(const MeshArena&) = delete;
+
+    // uploads the vertices (already packed in format) and the indices (of indexSize bytes each) of a mesh
+    MeshAllocation allocate(VertexFormat format, const void *vertexData, size_t vertexBytes, const void *indexData,
+                            size_t indexBytes, size_t indexSize)
+    {
+        size_t stride = vertexFormatSize(format);
+        MeshAllocation allocation;
+        allocation.vertexBytes = vertexBytes;
+        allocation.indexBytes = indexBytes;
+        for (unique_ptr<MeshArenaPage> &page : pages)
+            if (page->format == format && place(*page, stride, indexSize, allocation))
+                break;
+        if (!allocation.page)
+        {
+            pages.push_back(createPage(format, max(pageVertexBytes, vertexBytes + stride), max(pageIndexBytes, indexBytes + indexSize)));
+            place(*pages.back(), stride, indexSize, allocation);
+        }
+
+        // through the copy target, so no VAO's element array binding is touched
+        glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.page->vertexBuffer.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.vertexOffset, vertexBytes, vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.page->indexBuffer.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexBytes, indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    // gives a mesh's ranges back, deleting the page (through the GpuResourcePool) once it is empty
+    void free(MeshAllocation &allocation)
+    {
+        if (!allocation.page)
+            return;
+        MeshArenaPage *page = allocation.page;
+        page->vertices.free(allocation.vertexOffset, allocation.vertexBytes);
+        page->indices.free(allocation.indexOffset, allocation.indexBytes);
+        allocation.page = nullptr;
+        if (page->vertices.used == 0 && page->indices.used == 0)
+        {
+            auto it = find_if(pages.begin(), pages.end(), [&](const unique_ptr<MeshArenaPage> &p) { return p.get() == page; });
+            pages.erase(it);
+        }
+    }
+
+    void printStats() const
+    {
+        size_t vertexUsed = 0, vertexCapacity = 0, indexUsed = 0, indexCapacity = 0;
+        for (const unique_ptr<MeshArenaPage> &page : pages)
+        {
+            vertexUsed += page->vertices.used;
+            vertexCapacity += page->vertices.capacity;
+            indexUsed += page->indices.used;
+            indexCapacity += page->indices.capacity;
+        }
+        cout << "MESH_ARENA:: " << pages.size() << " pages, vertices " << vertexUsed / 1024 << "/" << vertexCapacity / 1024
+             << " KiB, indices " << indexUsed / 1024 << "/" << indexCapacity / 1024 << " KiB" << endl;
+    }
+
+private:
+    vector<unique_ptr<MeshArenaPage>> pages;
+
+    static bool place(MeshArenaPage &page, size_t stride, size_t indexSize, MeshAllocation &allocation)
+    {
+        if (!page.vertices.allocate(allocation.vertexBytes, stride, allocation.vertexOffset))
+            return false;
+        if (!page.indices.allocate(allocation.indexBytes, indexSize, allocation.indexOffset))
+        {
+            page.vertices.free(allocation.vertexOffset, allocation.vertexBytes);
+            return false;
+        }
+        allocation.page = &page;
+        return true;
+    }
+
+    static unique_ptr<MeshArenaPage> createPage(VertexFormat format, size_t vertexBytes, size_t indexBytes)
+    {
+        unique_ptr<MeshArenaPage> page(new MeshArenaPage());
+        page->format = format;
+        page->vertices = RangeAllocator(vertexBytes);
+        page->indices = RangeAllocator(indexBytes);
+
+        page->vertexArray = GpuVertexArray::create();
+        page->vertexBuffer = GpuBuffer::create(vertexBytes);
+        page->indexBuffer = GpuBuffer::create(indexBytes);
+        GLState::instance().bindVertexArray(page->vertexArray.id());
+        glBindBuffer(GL_ARRAY_BUFFER, page->vertexBuffer.id());
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page->indexBuffer.id());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+        setupVertexAttributes(format);
+        GLState::instance().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return page;
+    }
+};
+#endif
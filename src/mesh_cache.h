@@ -0,0 +1,385 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "mesh.h"
+
+using namespace std;
+
+// Binary mesh cache written next to a source asset ("<asset>.meshcache") so warm starts skip Assimp entirely.
+// Layout (native endianness, every section aligned to MESH_CACHE_ALIGN so it can be used in place from the mapping):
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount]
+//   MeshCacheTexture[textureCount]
+//   MeshCacheLod[lodCount]
+//   MeshCacheDependency[dependencyCount]
+//   per mesh: vertices packed in its VertexFormat[vertexCount], unsigned int[indexCount] (all its levels of detail)
+// Bump MESH_CACHE_VERSION whenever the layout or the import pipeline output changes.
+#define MESH_CACHE_VERSION 7
+#define MESH_CACHE_ALIGN 16
+
+static const char MESH_CACHE_MAGIC[8] = {'O', 'G', 'L', 'M', 'E', 'S', 'H', '\0'};
+
+struct MeshCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t vertexSize;     // sizeof(Vertex) of the writer, rejects caches built with another vertex layout
+    uint64_t sourceSize;     // size and modification time of the source asset, a changed asset invalidates the cache
+    int64_t  sourceMtime;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t lodCount;
+    uint32_t dependencyCount;
+    uint64_t importSettings; // hash of the import settings (welding, LOD chain) the meshes were built with
+    uint64_t fileSize;
+};
+
+struct MeshCacheEntry {
+    uint64_t  vertexOffset;
+    uint64_t  indexOffset;
+    uint32_t  vertexCount;
+    uint32_t  indexCount;
+    uint32_t  firstTexture;
+    uint32_t  textureCount;
+    uint32_t  firstLod;
+    uint32_t  lodCount;
+    uint32_t  vertexFormat;  // VertexFormat the vertices are packed in
+    uint32_t  padding;
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+};
+
+struct MeshCacheTexture {
+    char type[32];
+    char path[224];
+};
+
+typedef MeshLod MeshCacheLod;
+
+// another file the import read besides the source asset (the material libraries of an OBJ), with its size and
+// modification time at import; both 0 if it didn't exist
+struct MeshCacheDependency {
+    char     path[240];
+    uint64_t size;
+    int64_t  mtime;
+};
+
+// read-only view of a file, memory-mapped where the platform allows it
+class MappedFile {
+public:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string &path)
+    {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference to the file
+        if (mapping == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char*>(mapping);
+        size = (size_t)st.st_size;
+        return true;
+#else
+        // no mmap here, fall back to reading the whole file into memory
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file)
+            return false;
+        buffer.resize((size_t)file.tellg());
+        file.seekg(0);
+        if (buffer.empty() || !file.read(reinterpret_cast<char*>(buffer.data()), buffer.size()))
+            return false;
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (data)
+            munmap(const_cast<unsigned char*>(data), size);
+#else
+        buffer.clear();
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    vector<unsigned char> buffer;
+#endif
+};
+
+inline string meshCachePath(const string &sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+// size and modification time of the source asset, returns false if it can't be stat'ed
+inline bool meshCacheSourceStamp(const string &sourcePath, uint64_t &size, int64_t &mtime)
+{
+    struct stat st;
+    if (stat(sourcePath.c_str(), &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+    mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// the files besides sourcePath whose contents end up in the imported meshes: the material libraries named by the
+// mtllib statements of an OBJ (texture paths and types come from there), relative to its directory like Assimp reads them
+inline vector<string> meshCacheDependencies(const string &sourcePath)
+{
+    vector<string> dependencies;
+    size_t dot = sourcePath.find_last_of('.');
+    string extension = dot == string::npos ? string() : sourcePath.substr(dot + 1);
+    for (char &c : extension)
+        c = (char)tolower((unsigned char)c);
+    if (extension != "obj")
+        return dependencies;
+
+    size_t slash = sourcePath.find_last_of('/');
+    string directory = slash == string::npos ? string() : sourcePath.substr(0, slash + 1);
+    ifstream file(sourcePath);
+    string line;
+    while (getline(file, line))
+    {
+        if (line.compare(0, 6, "mtllib") != 0 || line.size() < 7 || !isspace((unsigned char)line[6]))
+            continue;
+        size_t begin = line.find_first_not_of(" \t", 7);
+        size_t end = line.find_last_not_of(" \t\r");
+        if (begin == string::npos || end < begin)
+            continue;
+        string path = directory + line.substr(begin, end - begin + 1);
+        if (find(dependencies.begin(), dependencies.end(), path) == dependencies.end())
+            dependencies.push_back(path);
+    }
+    return dependencies;
+}
+
+// stamp of a dependency as recorded in the cache, a missing file has size and mtime 0
+inline void meshCacheDependencyStamp(const string &path, uint64_t &size, int64_t &mtime)
+{
+    if (!meshCacheSourceStamp(path, size, mtime))
+        size = 0, mtime = 0;
+}
+
+inline uint64_t meshCacheAlign(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGN - 1) & ~(uint64_t)(MESH_CACHE_ALIGN - 1);
+}
+
+// maps the cache of sourcePath and checks that it is complete, still matches the source asset and was built with
+// importSettings. On success header/entries/textures/lods point into the mapping, which has to stay open while
+// they're used.
+inline bool openMeshCache(const string &sourcePath, uint64_t importSettings, MappedFile &file, const MeshCacheHeader *&header,
+                          const MeshCacheEntry *&entries, const MeshCacheTexture *&textures, const MeshCacheLod *&lods)
+{
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!meshCacheSourceStamp(sourcePath, sourceSize, sourceMtime))
+        return false;
+    if (!file.open(meshCachePath(sourcePath)) || file.size < sizeof(MeshCacheHeader))
+        return false;
+
+    header = reinterpret_cast<const MeshCacheHeader*>(file.data);
+    if (memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+        header->version != MESH_CACHE_VERSION || header->vertexSize != sizeof(Vertex) ||
+        header->sourceSize != sourceSize || header->sourceMtime != sourceMtime || header->fileSize != file.size ||
+        header->importSettings != importSettings)
+        return false;
+
+    uint64_t entriesOffset = meshCacheAlign(sizeof(MeshCacheHeader));
+    uint64_t texturesOffset = meshCacheAlign(entriesOffset + header->meshCount * sizeof(MeshCacheEntry));
+    uint64_t lodsOffset = meshCacheAlign(texturesOffset + header->textureCount * sizeof(MeshCacheTexture));
+    uint64_t dependenciesOffset = meshCacheAlign(lodsOffset + header->lodCount * sizeof(MeshCacheLod));
+    if (dependenciesOffset + header->dependencyCount * sizeof(MeshCacheDependency) > file.size)
+        return false;
+    entries = reinterpret_cast<const MeshCacheEntry*>(file.data + entriesOffset);
+    textures = reinterpret_cast<const MeshCacheTexture*>(file.data + texturesOffset);
+    lods = reinterpret_cast<const MeshCacheLod*>(file.data + lodsOffset);
+
+    // an edited material library changes the textures even though the source asset didn't change
+    const MeshCacheDependency *dependencies = reinterpret_cast<const MeshCacheDependency*>(file.data + dependenciesOffset);
+    for (uint32_t i = 0; i < header->dependencyCount; i++)
+    {
+        const MeshCacheDependency &dependency = dependencies[i];
+        if (memchr(dependency.path, '\0', sizeof(dependency.path)) == nullptr)
+            return false;
+        uint64_t size;
+        int64_t mtime;
+        meshCacheDependencyStamp(dependency.path, size, mtime);
+        if (size != dependency.size || mtime != dependency.mtime)
+            return false;
+    }
+
+    // a truncated or corrupted cache must never be handed to glBufferData
+    for (uint32_t i = 0; i < header->meshCount; i++)
+    {
+        const MeshCacheEntry &entry = entries[i];
+        if (entry.vertexFormat > (uint32_t)VertexFormat::QuantizedTangent ||
+            entry.vertexOffset + (uint64_t)entry.vertexCount * vertexFormatSize((VertexFormat)entry.vertexFormat) > file.size ||
+            entry.indexOffset + (uint64_t)entry.indexCount * sizeof(unsigned int) > file.size ||
+            (uint64_t)entry.firstTexture + entry.textureCount > header->textureCount ||
+            (uint64_t)entry.firstLod + entry.lodCount > header->lodCount)
+            return false;
+        for (uint32_t j = 0; j < entry.lodCount; j++)
+            if ((uint64_t)lods[entry.firstLod + j].firstIndex + lods[entry.firstLod + j].indexCount > entry.indexCount)
+                return false;
+    }
+    return true;
+}
+
+// writes the cache of sourcePath from the CPU-side data of meshes, which were imported with importSettings.
+// The file is written under a temporary name and renamed into place so a concurrent or interrupted run never sees a
+// half written cache.
+inline bool writeMeshCache(const string &sourcePath, const vector<Mesh> &meshes, uint64_t importSettings)
+{
+    MeshCacheHeader header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    if (!meshCacheSourceStamp(sourcePath, header.sourceSize, header.sourceMtime))
+        return false;
+    header.meshCount = (uint32_t)meshes.size();
+    header.importSettings = importSettings;
+
+    vector<MeshCacheDependency> dependencies;
+    for (const string &path : meshCacheDependencies(sourcePath))
+    {
+        MeshCacheDependency dependency;
+        memset(&dependency, 0, sizeof(dependency));
+        if (path.size() >= sizeof(dependency.path))
+            return false;
+        memcpy(dependency.path, path.c_str(), path.size());
+        meshCacheDependencyStamp(path, dependency.size, dependency.mtime);
+        dependencies.push_back(dependency);
+    }
+    header.dependencyCount = (uint32_t)dependencies.size();
+
+    vector<MeshCacheEntry> entries(meshes.size());
+    vector<MeshCacheTexture> textures;
+    vector<MeshCacheLod> lods;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        entries[i].firstLod = (uint32_t)lods.size();
+        entries[i].lodCount = (uint32_t)meshes[i].lods.size();
+        lods.insert(lods.end(), meshes[i].lods.begin(), meshes[i].lods.end());
+        entries[i].firstTexture = (uint32_t)textures.size();
+        entries[i].textureCount = (uint32_t)meshes[i].textures.size();
+        for (const Texture &texture : meshes[i].textures)
+        {
+            MeshCacheTexture record;
+            memset(&record, 0, sizeof(record));
+            if (texture.type.size() >= sizeof(record.type) || texture.path.size() >= sizeof(record.path))
+                return false;
+            memcpy(record.type, texture.type.c_str(), texture.type.size());
+            memcpy(record.path, texture.path.c_str(), texture.path.size());
+            textures.push_back(record);
+        }
+    }
+    header.textureCount = (uint32_t)textures.size();
+    header.lodCount = (uint32_t)lods.size();
+
+    // lay out the payload sections
+    uint64_t entriesOffset = meshCacheAlign(sizeof(MeshCacheHeader));
+    uint64_t texturesOffset = meshCacheAlign(entriesOffset + entries.size() * sizeof(MeshCacheEntry));
+    uint64_t lodsOffset = meshCacheAlign(texturesOffset + textures.size() * sizeof(MeshCacheTexture));
+    uint64_t dependenciesOffset = meshCacheAlign(lodsOffset + lods.size() * sizeof(MeshCacheLod));
+    uint64_t offset = meshCacheAlign(dependenciesOffset + dependencies.size() * sizeof(MeshCacheDependency));
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        entries[i].vertexCount = (uint32_t)meshes[i].vertices.size();
+        entries[i].vertexFormat = (uint32_t)meshes[i].vertexFormat;
+        entries[i].padding = 0;
+        entries[i].indexCount = (uint32_t)meshes[i].indices.size();
+        entries[i].aabbMin = meshes[i].aabbMin;
+        entries[i].aabbMax = meshes[i].aabbMax;
+        entries[i].vertexOffset = offset;
+        offset = meshCacheAlign(offset + entries[i].vertexCount * vertexFormatSize(meshes[i].vertexFormat));
+        entries[i].indexOffset = offset;
+        offset = meshCacheAlign(offset + entries[i].indexCount * sizeof(unsigned int));
+    }
+    header.fileSize = offset;
+
+    string cachePath = meshCachePath(sourcePath);
+    string tmpPath = cachePath + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        static const char zeros[MESH_CACHE_ALIGN] = {};
+        auto pad = [&](uint64_t to) { file.write(zeros, (streamsize)(to - (uint64_t)file.tellp())); };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        pad(entriesOffset);
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+        pad(texturesOffset);
+        file.write(reinterpret_cast<const char*>(textures.data()), textures.size() * sizeof(MeshCacheTexture));
+        pad(lodsOffset);
+        file.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshCacheLod));
+        pad(dependenciesOffset);
+        file.write(reinterpret_cast<const char*>(dependencies.data()), dependencies.size() * sizeof(MeshCacheDependency));
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            pad(entries[i].vertexOffset);
+            vector<unsigned char> packed = packVertices(meshes[i].vertexFormat, meshes[i].vertices.data(), meshes[i].vertices.size(),
+                                                        meshes[i].positionDecode);
+            file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+            pad(entries[i].indexOffset);
+            file.write(reinterpret_cast<const char*>(meshes[i].indices.data()), entries[i].indexCount * sizeof(unsigned int));
+        }
+        pad(header.fileSize);
+        if (!file)
+        {
+            file.close();
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+#ifdef _WIN32
+    remove(cachePath.c_str()); // rename() doesn't replace an existing file there
+#endif
+    if (rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+#endif
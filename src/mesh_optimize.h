@@ -0,0 +1,379 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+using namespace std;
+
+// post transform vertex cache behaviour of an index list on a FIFO cache
+struct VertexCacheStats {
+    size_t transformed = 0;  // cache misses, i.e. vertex shader invocations
+    size_t triangles = 0;
+    size_t vertices = 0;     // distinct vertices referenced
+
+    // average cache miss ratio, transformed vertices per triangle (0.5 at best on a large regular mesh, 3 at worst)
+    float acmr() const { return triangles ? (float)transformed / triangles : 0.0f; }
+    // average transform to vertex ratio, transformed vertices per distinct vertex (1 at best)
+    float atvr() const { return vertices ? (float)transformed / vertices : 0.0f; }
+
+    VertexCacheStats &operator+=(const VertexCacheStats &other)
+    {
+        transformed += other.transformed;
+        triangles += other.triangles;
+        vertices += other.vertices;
+        return *this;
+    }
+};
+
+// pixels shaded against pixels covered when the triangles are drawn in order with a depth test
+struct OverdrawStats {
+    size_t covered = 0;
+    size_t shaded = 0;
+
+    // 1 when every covered pixel is shaded exactly once
+    float overdraw() const { return covered ? (float)shaded / covered : 0.0f; }
+
+    OverdrawStats &operator+=(const OverdrawStats &other)
+    {
+        covered += other.covered;
+        shaded += other.shaded;
+        return *this;
+    }
+};
+
+// Reorders the triangles and vertices of an indexed mesh for the GPU, without changing what is drawn:
+//  - optimizeVertexCache: Tipsify (Sander, Nehab & Barczak, "Fast triangle reordering for vertex locality and reduced
+//    overdraw"), fans around vertices while they are likely still in the post transform cache;
+//  - optimizeOverdraw: splits that order into clusters and sorts the clusters so the ones facing outwards, which tend to
+//    occlude the rest, are drawn first, giving up at most a threshold of the cache efficiency;
+//  - optimizeVertexFetch: renumbers the vertices in the order the indices first use them, so fetches walk the vertex
+//    buffer forward.
+// The first two work on one index range at a time (a level of detail), the last on the whole index buffer.
+class MeshOptimizer {
+public:
+    static const unsigned int CACHE_SIZE = 16;
+
+    // reorders the triangles in indices[first, first + count) for the post transform cache; clusters, if given,
+    // receives the offsets (from first) where Tipsify had to restart away from the last fan, used by optimizeOverdraw
+    static void optimizeVertexCache(vector<unsigned int> &indices, size_t first, size_t count, size_t vertexCount,
+                                    vector<size_t> *clusters = nullptr)
+    {
+        size_t triangleCount = count / 3;
+        if (triangleCount == 0)
+            return;
+        const unsigned int *source = indices.data() + first;
+
+        // vertex -> triangles adjacency
+        vector<unsigned int> live(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            live[source[i]]++;
+        vector<size_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] = adjacencyStart[v] + live[v];
+        vector<unsigned int> adjacency(triangleCount * 3);
+        vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int c = 0; c < 3; c++)
+                adjacency[fill[source[t * 3 + c]]++] = (unsigned int)t;
+
+        vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        vector<size_t> cacheTime(vertexCount, 0);
+        vector<bool> emitted(triangleCount, false);
+        vector<unsigned int> deadEnd;
+        vector<unsigned int> candidates;
+        size_t time = CACHE_SIZE + 1;
+        size_t cursor = 0;
+
+        long fan = skipDeadEnd(live, deadEnd, cursor);
+        if (clusters)
+            clusters->push_back(0);
+        while (fan >= 0)
+        {
+            candidates.clear();
+            for (size_t a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; a++)
+            {
+                unsigned int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int v = source[t * 3 + c];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - cacheTime[v] > CACHE_SIZE)
+                        cacheTime[v] = time++;
+                }
+                emitted[t] = true;
+            }
+
+            // the candidate still in the cache after its remaining triangles are emitted that entered it first
+            long next = -1;
+            size_t best = 0;
+            for (unsigned int v : candidates)
+            {
+                if (live[v] == 0)
+                    continue;
+                size_t priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= CACHE_SIZE)
+                    priority = time - cacheTime[v];
+                if (next < 0 || priority > best)
+                {
+                    best = priority;
+                    next = v;
+                }
+            }
+            if (next < 0)
+            {
+                next = skipDeadEnd(live, deadEnd, cursor);
+                if (clusters && next >= 0 && result.size() < triangleCount * 3)
+                    clusters->push_back(result.size());
+            }
+            fan = next;
+        }
+        copy(result.begin(), result.end(), indices.begin() + first);
+    }
+
+    // sorts the clusters of a cache optimized range (from optimizeVertexCache) front to back as seen from outside the
+    // mesh. Clusters are first cut into smaller ones as long as their cache miss ratio stays within threshold of the
+    // original, so the ACMR gets at most that much worse.
+    static void optimizeOverdraw(vector<unsigned int> &indices, size_t first, size_t count, const Vertex *vertices,
+                                 size_t vertexCount, const vector<size_t> &hardClusters, float threshold = 1.05f)
+    {
+        size_t triangleCount = count / 3;
+        if (triangleCount == 0 || hardClusters.empty())
+            return;
+        const unsigned int *source = indices.data() + first;
+
+        // soft cluster boundaries: cut wherever a fresh cache has caught up with the cluster's own miss ratio
+        vector<size_t> clusters;
+        vector<size_t> cacheTime(vertexCount, 0);
+        size_t time = 0;
+        for (size_t h = 0; h < hardClusters.size(); h++)
+        {
+            size_t begin = hardClusters[h] / 3;
+            size_t end = h + 1 < hardClusters.size() ? hardClusters[h + 1] / 3 : triangleCount;
+            float clusterAcmr = missRatio(source, begin, end, cacheTime, time);
+
+            clusters.push_back(begin * 3);
+            time += CACHE_SIZE + 1;  // flush
+            size_t start = begin, misses = 0;
+            for (size_t t = begin; t < end; t++)
+            {
+                for (int c = 0; c < 3; c++)
+                    if (access(source[t * 3 + c], cacheTime, time))
+                        misses++;
+                if (t + 1 < end && (float)misses / (t + 1 - start) <= threshold * clusterAcmr)
+                {
+                    clusters.push_back((t + 1) * 3);
+                    time += CACHE_SIZE + 1;
+                    start = t + 1;
+                    misses = 0;
+                }
+            }
+        }
+
+        // centroid of the whole range and area weighted centroid and normal of each cluster
+        glm::dvec3 meshCentroid(0.0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            meshCentroid += glm::dvec3(vertices[source[i]].Position);
+        meshCentroid /= (double)(triangleCount * 3);
+
+        vector<pair<double, size_t>> order(clusters.size());
+        for (size_t k = 0; k < clusters.size(); k++)
+        {
+            size_t end = k + 1 < clusters.size() ? clusters[k + 1] : triangleCount * 3;
+            glm::dvec3 centroid(0.0), normal(0.0);
+            double area = 0.0;
+            for (size_t i = clusters[k]; i < end; i += 3)
+            {
+                glm::dvec3 a(vertices[source[i]].Position), b(vertices[source[i + 1]].Position), c(vertices[source[i + 2]].Position);
+                glm::dvec3 n = glm::cross(b - a, c - a);
+                double weight = glm::length(n);
+                centroid += (a + b + c) * (weight / 3.0);
+                normal += n;
+                area += weight;
+            }
+            double key = 0.0;
+            if (area > 0.0 && glm::length(normal) > 0.0)
+                key = glm::dot(centroid / area - meshCentroid, glm::normalize(normal));
+            order[k] = make_pair(-key, k);
+        }
+        stable_sort(order.begin(), order.end(), [](const pair<double, size_t> &a, const pair<double, size_t> &b) { return a.first < b.first; });
+
+        vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        for (const pair<double, size_t> &entry : order)
+        {
+            size_t k = entry.second;
+            size_t end = k + 1 < clusters.size() ? clusters[k + 1] : triangleCount * 3;
+            result.insert(result.end(), source + clusters[k], source + end);
+        }
+        copy(result.begin(), result.end(), indices.begin() + first);
+    }
+
+    // renumbers the vertices by first use in indices and drops the unused ones, returns the new vertex count
+    static size_t optimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        const unsigned int unused = 0xffffffffu;
+        vector<unsigned int> remap(vertices.size(), unused);
+        vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = (unsigned int)reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+        return vertices.size();
+    }
+
+    // FIFO cache simulation of the count indices
+    static VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t count, size_t vertexCount)
+    {
+        VertexCacheStats stats;
+        stats.triangles = count / 3;
+        vector<size_t> cacheTime(vertexCount, 0);
+        vector<bool> seen(vertexCount, false);
+        size_t time = CACHE_SIZE + 1;
+        for (size_t i = 0; i < stats.triangles * 3; i++)
+        {
+            if (access(indices[i], cacheTime, time))
+                stats.transformed++;
+            if (!seen[indices[i]])
+            {
+                seen[indices[i]] = true;
+                stats.vertices++;
+            }
+        }
+        return stats;
+    }
+
+    // rasterizes the triangles in order, back faces culled, into a depth buffer looking at the mesh along each of
+    // the six axis directions and counts how often covered pixels get shaded
+    static OverdrawStats analyzeOverdraw(const unsigned int *indices, size_t count, const Vertex *vertices, size_t vertexCount)
+    {
+        OverdrawStats stats;
+        size_t triangleCount = count / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return stats;
+
+        glm::vec3 low(INFINITY), high(-INFINITY);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            low = glm::min(low, vertices[indices[i]].Position);
+            high = glm::max(high, vertices[indices[i]].Position);
+        }
+        glm::vec3 extent = high - low;
+        float scale = (float)(OVERDRAW_VIEWPORT - 1) / max(max(extent.x, extent.y), max(extent.z, 1e-12f));
+
+        vector<float> depth(OVERDRAW_VIEWPORT * OVERDRAW_VIEWPORT);
+        for (int axis = 0; axis < 3; axis++)
+            for (int side = -1; side <= 1; side += 2)
+            {
+                fill(depth.begin(), depth.end(), INFINITY);
+                int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                for (size_t t = 0; t < triangleCount; t++)
+                {
+                    glm::vec3 p[3];
+                    for (int c = 0; c < 3; c++)
+                    {
+                        glm::vec3 position = (vertices[indices[t * 3 + c]].Position - low) * scale;
+                        // looking down -side along the axis: closer means a larger coordinate for side 1
+                        p[c] = glm::vec3(position[u], position[v], -side * position[axis]);
+                    }
+                    rasterize(p, side, depth, stats);
+                }
+                for (float d : depth)
+                    if (d != INFINITY)
+                        stats.covered++;
+            }
+        return stats;
+    }
+
+private:
+    static const int OVERDRAW_VIEWPORT = 256;
+
+    // touches vertex in a FIFO cache of timestamps, returns true on a miss
+    static bool access(unsigned int vertex, vector<size_t> &cacheTime, size_t &time)
+    {
+        if (time - cacheTime[vertex] > CACHE_SIZE)
+        {
+            cacheTime[vertex] = time++;
+            return true;
+        }
+        return false;
+    }
+
+    static float missRatio(const unsigned int *indices, size_t begin, size_t end, vector<size_t> &cacheTime, size_t &time)
+    {
+        time += CACHE_SIZE + 1;
+        size_t misses = 0;
+        for (size_t i = begin * 3; i < end * 3; i++)
+            if (access(indices[i], cacheTime, time))
+                misses++;
+        return end > begin ? (float)misses / (end - begin) : 0.0f;
+    }
+
+    // the next vertex to fan around once the last fan's vertices are used up: the most recently emitted one that still
+    // has triangles left, else the next such vertex in index order; -1 when every triangle is out
+    static long skipDeadEnd(const vector<unsigned int> &live, vector<unsigned int> &deadEnd, size_t &cursor)
+    {
+        while (!deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                return v;
+        }
+        for (; cursor < live.size(); cursor++)
+            if (live[cursor] > 0)
+                return (long)cursor;
+        return -1;
+    }
+
+    // one triangle in viewport space (z = depth), with the depth test and the counting of shaded pixels
+    static void rasterize(const glm::vec3 p[3], int side, vector<float> &depth, OverdrawStats &stats)
+    {
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        // counter-clockwise front faces; the view along -axis mirrors the image
+        if (area * side <= 0.0f)
+            return;
+
+        int minX = max(0, (int)floor(min(min(p[0].x, p[1].x), p[2].x)));
+        int maxX = min(OVERDRAW_VIEWPORT - 1, (int)ceil(max(max(p[0].x, p[1].x), p[2].x)));
+        int minY = max(0, (int)floor(min(min(p[0].y, p[1].y), p[2].y)));
+        int maxY = min(OVERDRAW_VIEWPORT - 1, (int)ceil(max(max(p[0].y, p[1].y), p[2].y)));
+        for (int y = minY; y <= maxY; y++)
+            for (int x = minX; x <= maxX; x++)
+            {
+                float px = x + 0.5f, py = y + 0.5f;
+                float w0 = ((p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x)) / area;
+                float w1 = ((p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x)) / area;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                float z = w0 * p[0].z + w1 * p[1].z + w2 * p[2].z;
+                float &stored = depth[y * OVERDRAW_VIEWPORT + x];
+                if (z < stored)
+                {
+                    stored = z;
+                    stats.shaded++;
+                }
+            }
+    }
+};
+#endif
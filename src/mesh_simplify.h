@@ -0,0 +1,330 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.h"
+
+using namespace std;
+
+// one level of a LOD chain: the share of the full mesh's triangles to keep, and the largest error (relative to the
+// mesh's bounding radius) the simplification may introduce to get there. The error wins if the two disagree.
+struct LodLevel {
+    float ratio;
+    float maxError;
+};
+
+// identifies a LOD chain's settings, e.g. to tell whether cached levels were made with them (0 for no chain)
+inline uint64_t lodLevelsHash(const vector<LodLevel> &levels)
+{
+    if (levels.empty())
+        return 0;
+    // FNV-1a over the raw floats
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(levels.data());
+    for (size_t i = 0; i < levels.size() * sizeof(LodLevel); i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Quadric error metric simplification (Garland & Heckbert) by edge collapse. Vertices are only ever collapsed onto
+// other existing vertices, so a simplified level is just another index list into the same vertex buffer.
+//
+// Topology is tracked per position rather than per vertex: imports split vertices along UV and normal seams, and two
+// vertices at the same position must move together or the surface tears. When a position collapses onto another,
+// each of its vertices takes the vertex of the target position it shared an edge with, so seams mostly survive.
+// Positions on an open border are never removed.
+class MeshSimplifier {
+public:
+    // simplifies the triangles in indices towards targetIndexCount without exceeding maxError (object space units).
+    // Returns the new index list; error receives the largest error actually introduced.
+    static vector<unsigned int> simplify(const Vertex *vertices, size_t vertexCount, const vector<unsigned int> &indices,
+                                         size_t targetIndexCount, float maxError, float *error = nullptr)
+    {
+        MeshSimplifier simplifier(vertices, vertexCount, indices);
+        simplifier.run(targetIndexCount, maxError);
+        if (error)
+            *error = simplifier.resultError;
+        return simplifier.triangles;
+    }
+
+    // radius of the bounding sphere around the box of the vertices, what LodLevel::maxError is relative to
+    static float boundingRadius(const Vertex *vertices, size_t vertexCount)
+    {
+        if (vertexCount == 0)
+            return 0.0f;
+        glm::vec3 low = vertices[0].Position, high = vertices[0].Position;
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            low = glm::min(low, vertices[i].Position);
+            high = glm::max(high, vertices[i].Position);
+        }
+        return glm::length(high - low) * 0.5f;
+    }
+
+private:
+    // symmetric 4x4 matrix, upper triangle row by row
+    struct Quadric {
+        double q[10] = {};
+
+        void addPlane(const glm::dvec3 &normal, double distance, double weight)
+        {
+            double p[4] = {normal.x, normal.y, normal.z, distance};
+            int k = 0;
+            for (int row = 0; row < 4; row++)
+                for (int column = row; column < 4; column++)
+                    q[k++] += weight * p[row] * p[column];
+        }
+        void add(const Quadric &other)
+        {
+            for (int k = 0; k < 10; k++)
+                q[k] += other.q[k];
+        }
+        // sum of the weighted squared distances of point to the planes
+        double error(const glm::dvec3 &point) const
+        {
+            double x = point.x, y = point.y, z = point.z;
+            return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+                 + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+                 + q[7] * z * z + 2.0 * q[8] * z
+                 + q[9];
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        unsigned int from, to; // positions
+    };
+
+    static const unsigned int NONE = 0xffffffffu;
+
+    vector<unsigned int> triangles;
+    vector<unsigned int> positionOf;     // vertex -> position
+    vector<glm::dvec3> positions;
+    vector<Quadric> quadrics;
+    vector<double> weights;              // total plane weight per position, turns a quadric error into a distance
+    vector<unsigned char> locked;
+    float resultError = 0.0f;
+
+    MeshSimplifier(const Vertex *vertices, size_t vertexCount, const vector<unsigned int> &indices)
+        : triangles(indices)
+    {
+        // vertices sharing a position bit for bit share a topological position
+        struct Key {
+            uint32_t bits[3];
+            bool operator==(const Key &other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key &key) const
+            {
+                return (size_t)key.bits[0] * 73856093u ^ (size_t)key.bits[1] * 19349663u ^ (size_t)key.bits[2] * 83492791u;
+            }
+        };
+        unordered_map<Key, unsigned int, KeyHash> positionIds;
+        positionIds.reserve(vertexCount);
+        positionOf.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            Key key;
+            memcpy(key.bits, &vertices[i].Position, sizeof(key.bits));
+            auto it = positionIds.emplace(key, (unsigned int)positions.size());
+            if (it.second)
+                positions.push_back(glm::dvec3(vertices[i].Position));
+            positionOf[i] = it.first->second;
+        }
+
+        quadrics.resize(positions.size());
+        weights.assign(positions.size(), 0.0);
+        locked.assign(positions.size(), 0);
+
+        // every triangle adds its plane to its corners, weighted by its area
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+        {
+            unsigned int p[3] = {positionOf[triangles[t]], positionOf[triangles[t + 1]], positionOf[triangles[t + 2]]};
+            glm::dvec3 normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            double area = glm::length(normal);
+            if (area <= 0.0)
+                continue;
+            normal /= area;
+            double distance = -glm::dot(normal, positions[p[0]]);
+            for (unsigned int corner : p)
+            {
+                quadrics[corner].addPlane(normal, distance, area);
+                weights[corner] += area;
+            }
+        }
+
+        // an edge only one triangle walks in its direction and none the other way is on a border
+        unordered_map<uint64_t, int> edges;
+        edges.reserve(triangles.size());
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = positionOf[triangles[t + e]], b = positionOf[triangles[t + (e + 1) % 3]];
+                edges[(uint64_t)a << 32 | b]++;
+            }
+        for (const auto &edge : edges)
+        {
+            unsigned int a = (unsigned int)(edge.first >> 32), b = (unsigned int)edge.first;
+            if (edges.find((uint64_t)b << 32 | a) == edges.end())
+                locked[a] = locked[b] = 1;
+        }
+    }
+
+    double distanceError(const Quadric &quadric, double weight, const glm::dvec3 &point) const
+    {
+        return weight > 0.0 ? sqrt(max(quadric.error(point), 0.0) / weight) : 0.0;
+    }
+
+    // true if moving position from to position to flips or squashes one of the triangles around from
+    bool flips(unsigned int from, unsigned int to, const vector<unsigned int> &adjacencyStart, const vector<unsigned int> &adjacency) const
+    {
+        for (unsigned int k = adjacencyStart[from]; k < adjacencyStart[from + 1]; k++)
+        {
+            size_t t = adjacency[k];
+            unsigned int p[3] = {positionOf[triangles[t]], positionOf[triangles[t + 1]], positionOf[triangles[t + 2]]};
+            if (p[0] == to || p[1] == to || p[2] == to)
+                continue; // collapses away
+            glm::dvec3 before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            for (unsigned int &corner : p)
+                if (corner == from)
+                    corner = to;
+            glm::dvec3 after = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            if (glm::dot(before, after) <= 0.25 * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+
+    // collapses edges in passes: each pass ranks every edge by the cheaper of its two directions and takes the cheapest
+    // ones whose positions no other collapse of the pass has touched, until the target or the error limit is reached
+    void run(size_t targetIndexCount, float maxError)
+    {
+        vector<unsigned int> collapseTo(positions.size(), NONE);
+        vector<unsigned char> touched(positions.size());
+        vector<unsigned int> adjacencyStart, adjacency;
+        vector<Collapse> collapses;
+
+        while (triangles.size() > targetIndexCount)
+        {
+            // triangles around each position
+            adjacencyStart.assign(positions.size() + 1, 0);
+            for (unsigned int index : triangles)
+                adjacencyStart[positionOf[index] + 1]++;
+            for (size_t p = 0; p < positions.size(); p++)
+                adjacencyStart[p + 1] += adjacencyStart[p];
+            adjacency.resize(triangles.size());
+            vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t t = 0; t < triangles.size(); t += 3)
+                for (int c = 0; c < 3; c++)
+                    adjacency[fill[positionOf[triangles[t + c]]]++] = (unsigned int)t;
+
+            // candidate collapses, every edge once
+            collapses.clear();
+            for (size_t t = 0; t < triangles.size(); t += 3)
+                for (int e = 0; e < 3; e++)
+                {
+                    unsigned int a = positionOf[triangles[t + e]], b = positionOf[triangles[t + (e + 1) % 3]];
+                    if (a >= b || (locked[a] && locked[b]))
+                        continue; // the reverse walk of the edge covers a > b
+                    Quadric merged = quadrics[a];
+                    merged.add(quadrics[b]);
+                    double weight = weights[a] + weights[b];
+                    double toB = locked[a] ? INFINITY : distanceError(merged, weight, positions[b]);
+                    double toA = locked[b] ? INFINITY : distanceError(merged, weight, positions[a]);
+                    if (toB <= toA)
+                        collapses.push_back(Collapse{toB, a, b});
+                    else
+                        collapses.push_back(Collapse{toA, b, a});
+                }
+            sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y)
+            {
+                return x.cost < y.cost || (x.cost == y.cost && (x.from < y.from || (x.from == y.from && x.to < y.to)));
+            });
+
+            // a collapse takes out about two triangles
+            size_t goal = (triangles.size() - targetIndexCount) / 3;
+            size_t removed = 0;
+            std::fill(touched.begin(), touched.end(), 0);
+            vector<unsigned int> collapsed;
+            for (const Collapse &collapse : collapses)
+            {
+                if (removed >= goal || collapse.cost > maxError)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to] || collapseTo[collapse.from] != NONE)
+                    continue;
+                if (flips(collapse.from, collapse.to, adjacencyStart, adjacency))
+                    continue;
+                collapseTo[collapse.from] = collapse.to;
+                touched[collapse.from] = touched[collapse.to] = 1;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                weights[collapse.to] += weights[collapse.from];
+                resultError = max(resultError, (float)collapse.cost);
+                collapsed.push_back(collapse.from);
+                removed += 2;
+            }
+            if (collapsed.empty())
+                break;
+            applyCollapses(collapseTo);
+            for (unsigned int position : collapsed)
+                collapseTo[position] = NONE;
+        }
+    }
+
+    // moves the vertices of collapsed positions onto vertices of their targets and drops the triangles that degenerate
+    void applyCollapses(const vector<unsigned int> &collapseTo)
+    {
+        // prefer the target vertex the moving vertex shares an edge with (same side of any seam)
+        unordered_map<unsigned int, unsigned int> vertexTarget;
+        for (size_t t = 0; t < triangles.size(); t += 3)
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int vertex = triangles[t + c];
+                unsigned int target = collapseTo[positionOf[vertex]];
+                if (target == NONE)
+                    continue;
+                for (int other = 1; other < 3; other++)
+                {
+                    unsigned int neighbour = triangles[t + (c + other) % 3];
+                    if (positionOf[neighbour] == target)
+                        vertexTarget[vertex] = neighbour;
+                }
+            }
+        // otherwise any vertex of the target position will do
+        unordered_map<unsigned int, unsigned int> positionVertex;
+        for (unsigned int index : triangles)
+            positionVertex.emplace(positionOf[index], index);
+
+        size_t write = 0;
+        for (size_t t = 0; t < triangles.size(); t += 3)
+        {
+            unsigned int corners[3];
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int vertex = triangles[t + c];
+                unsigned int target = collapseTo[positionOf[vertex]];
+                if (target != NONE)
+                {
+                    auto it = vertexTarget.find(vertex);
+                    vertex = it != vertexTarget.end() ? it->second : positionVertex[target];
+                }
+                corners[c] = vertex;
+            }
+            unsigned int p0 = positionOf[corners[0]], p1 = positionOf[corners[1]], p2 = positionOf[corners[2]];
+            if (p0 == p1 || p1 == p2 || p0 == p2)
+                continue;
+            triangles[write++] = corners[0];
+            triangles[write++] = corners[1];
+            triangles[write++] = corners[2];
+        }
+        triangles.resize(write);
+    }
+};
+#endif
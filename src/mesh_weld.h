@@ -0,0 +1,187 @@
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// how far apart two vertices' attributes may be and still be welded into one; 0 compares the exact bits
+struct WeldTolerance {
+    float position = 1e-5f;
+    float normal   = 1e-3f;
+    float texCoord = 1e-5f;
+    float tangent  = 1e-2f;  // tangent and bitangent
+};
+
+// Merges the vertices of an indexed mesh whose attributes all agree within a WeldTolerance and rewrites the indices.
+// Importers without vertex joining emit an unshared vertex per face corner; welding them back gives the post
+// transform cache something to reuse and shrinks the vertex buffer, typically to a third to a sixth of its size.
+//
+// Every attribute is snapped to a grid of its tolerance and vertices in the same cell of every attribute are the same
+// vertex, so two values right next to each other can end up on both sides of a cell border and stay apart. Hashing
+// runs in parallel; the vertices are then split into partitions by hash and each partition is welded by one job, so
+// the result (the first vertex of each group is kept, in the original order) doesn't depend on the thread count.
+class VertexWelder {
+public:
+    // welds vertices in place and remaps indices, returns the new vertex count
+    static size_t weld(vector<Vertex> &vertices, vector<unsigned int> &indices, const WeldTolerance &tolerance = WeldTolerance())
+    {
+        size_t count = vertices.size();
+        if (count < 2)
+            return count;
+
+        // cell hash of every vertex
+        vector<uint64_t> hashes(count);
+        ThreadPool::shared().parallelFor(count, 16384, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                hashes[i] = hashVertex(vertices[i], tolerance);
+        });
+
+        // counting sort of the vertex indices by partition, in index order within each
+        vector<uint32_t> partitionStart(PARTITIONS + 1, 0);
+        for (uint64_t hash : hashes)
+            partitionStart[partitionOf(hash) + 1]++;
+        for (unsigned int p = 0; p < PARTITIONS; p++)
+            partitionStart[p + 1] += partitionStart[p];
+        vector<uint32_t> order(count);
+        vector<uint32_t> fill(partitionStart.begin(), partitionStart.end() - 1);
+        for (size_t i = 0; i < count; i++)
+            order[fill[partitionOf(hashes[i])]++] = (uint32_t)i;
+
+        // each vertex points at the first vertex of its group
+        vector<uint32_t> representative(count);
+        ThreadPool::shared().parallelFor(PARTITIONS, 1, [&](size_t firstPartition, size_t lastPartition)
+        {
+            for (size_t p = firstPartition; p < lastPartition; p++)
+            {
+                // a hash can be shared by groups that aren't equal, those chain from one group to the next
+                unordered_map<uint64_t, uint32_t> firstByHash;
+                firstByHash.reserve(partitionStart[p + 1] - partitionStart[p]);
+                unordered_map<uint32_t, uint32_t> chain;
+                for (uint32_t k = partitionStart[p]; k < partitionStart[p + 1]; k++)
+                {
+                    uint32_t i = order[k];
+                    auto it = firstByHash.emplace(hashes[i], i);
+                    if (it.second)
+                    {
+                        representative[i] = i;
+                        continue;
+                    }
+                    uint32_t candidate = it.first->second;
+                    for (;;)
+                    {
+                        if (sameCell(vertices[candidate], vertices[i], tolerance))
+                        {
+                            representative[i] = candidate;
+                            break;
+                        }
+                        auto link = chain.find(candidate);
+                        if (link == chain.end())
+                        {
+                            chain[candidate] = i;
+                            representative[i] = i;
+                            break;
+                        }
+                        candidate = link->second;
+                    }
+                }
+            }
+        });
+
+        // kept vertices move down in order, the others take the new index of their representative
+        vector<uint32_t> remap(count);
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (representative[i] == i)
+            {
+                remap[i] = (uint32_t)kept;
+                vertices[kept++] = vertices[i];
+            }
+            else
+                remap[i] = remap[representative[i]];
+        }
+        vertices.resize(kept);
+
+        ThreadPool::shared().parallelFor(indices.size(), 65536, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                indices[i] = remap[indices[i]];
+        });
+        return kept;
+    }
+
+private:
+    static const unsigned int PARTITIONS = 64;
+
+    static unsigned int partitionOf(uint64_t hash) { return (unsigned int)(hash >> 58); }
+
+    // grid cell of value, or its bits for a tolerance of 0
+    static int64_t cell(float value, float tolerance)
+    {
+        if (tolerance <= 0.0f)
+        {
+            if (value == 0.0f)
+                value = 0.0f; // -0 and +0
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+        return (int64_t)floor((double)value / tolerance);
+    }
+
+    // calls visit(cell) for every attribute component of vertex
+    template<typename Visit>
+    static void forEachCell(const Vertex &vertex, const WeldTolerance &tolerance, Visit visit)
+    {
+        for (int c = 0; c < 3; c++)
+            visit(cell(vertex.Position[c], tolerance.position));
+        for (int c = 0; c < 3; c++)
+            visit(cell(vertex.Normal[c], tolerance.normal));
+        for (int c = 0; c < 2; c++)
+            visit(cell(vertex.TexCoords[c], tolerance.texCoord));
+        for (int c = 0; c < 3; c++)
+            visit(cell(vertex.Tangent[c], tolerance.tangent));
+        for (int c = 0; c < 3; c++)
+            visit(cell(vertex.Bitangent[c], tolerance.tangent));
+        for (int c = 0; c < MAX_BONE_INFLUENCE; c++)
+        {
+            visit((int64_t)vertex.m_BoneIDs[c]);
+            visit(cell(vertex.m_Weights[c], 0.0f));
+        }
+    }
+
+    static uint64_t hashVertex(const Vertex &vertex, const WeldTolerance &tolerance)
+    {
+        // FNV-1a over the cells, then a final mix so the top bits (the partition) are spread too
+        uint64_t hash = 14695981039346656037ull;
+        forEachCell(vertex, tolerance, [&](int64_t value)
+        {
+            hash = (hash ^ (uint64_t)value) * 1099511628211ull;
+        });
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static bool sameCell(const Vertex &a, const Vertex &b, const WeldTolerance &tolerance)
+    {
+        int64_t cellsA[32], cellsB[32];
+        int countA = 0, countB = 0;
+        forEachCell(a, tolerance, [&](int64_t value) { cellsA[countA++] = value; });
+        forEachCell(b, tolerance, [&](int64_t value) { cellsB[countB++] = value; });
+        return memcmp(cellsA, cellsB, countA * sizeof(int64_t)) == 0;
+    }
+};
+#endif
@@ -11,45 +11,315 @@
 #include <assimp/postprocess.h>
 
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include "draw_batch.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+#include "mesh_weld.h"
+#include "render_queue.h"
 #include "shader.h"
+#include "texture_array.h"
+#include "texture_registry.h"
+#include "thread_pool.h"
 
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// material texture of an imported mesh, by sampler type and path relative to the model directory
+struct MeshTextureRef {
+    string type;
+    string path;
+};
+
+// CPU-side result of converting one aiMesh, produced off the context thread
+struct MeshData {
+    vector<Vertex>         vertices;
+    vector<unsigned int>   indices;
+    vector<MeshTextureRef> textures;
+    vector<MeshLod>        lods;
+    VertexFormat           format = VertexFormat::Basic;  // what the GPU gets of the vertices
+    size_t                 importedVertices = 0;  // vertex count before welding
+    double                 weldMs = 0.0;
+    VertexCacheStats       cacheBefore, cacheAfter;        // of level 0, before and after optimizeMesh
+    OverdrawStats          overdrawBefore, overdrawAfter;
+};
+
 class Model 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// stores all the textures this model uses, each one holds a reference in the texture registry.
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    // levels of detail generated for every mesh at load time, after the full detail level 0
+    vector<LodLevel> lodLevels;
+    // vertices of an imported mesh closer than this in every attribute are welded into one
+    WeldTolerance weldTolerance;
+    // upload the static meshes in the quantized vertex formats, for shaders that decode positionOffset/positionScale
+    bool quantizeVertices;
+    // buffers the meshes are packed into
+    MeshArena &arena;
+    // whether the meshes keep their vertices and indices in CPU memory once uploaded (and the mesh cache written)
+    MeshRetention retention;
+    // give normal mapped meshes the tangent frame (the Tangent formats); off for shaders that never read tangents, whose
+    // attribute locations 3 and 4 are then free (e.g. for instance data) and whose vertices stay smaller
+    bool tangentFrame;
+    // Draw(shader) issues one multi-draw per material instead of a draw per mesh
+    bool batchDraws = true;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. With lodLevels each mesh gets a LOD chain, e.g.
+    // {{0.5f, 0.02f}, {0.25f, 0.05f}} adds levels with half and a quarter of the triangles.
+    Model(string const &path, bool gamma = false, const vector<LodLevel> &lodLevels = vector<LodLevel>(),
+          const WeldTolerance &weldTolerance = WeldTolerance(), bool quantizeVertices = false, MeshArena &arena = MeshArena::shared(),
+          MeshRetention retention = MeshRetention::DropAfterUpload, bool tangentFrame = true)
+        : gammaCorrection(gamma), lodLevels(lodLevels), weldTolerance(weldTolerance), quantizeVertices(quantizeVertices), arena(arena),
+          retention(retention), tangentFrame(tangentFrame)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // the model owns registry references to its textures, so it can't be copied
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    ~Model()
+    {
+        for (const Texture &texture : textures_loaded)
+            TextureRegistry::instance().release(texture.id);
+    }
+
+    // draws the model, and thus all its meshes: the meshes of a material are bound once and drawn together
     void Draw(Shader &shader)
+    {
+        if (!batchDraws)
+        {
+            for(unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].Draw(shader);
+            return;
+        }
+        for (size_t i = 0; i < drawOrder.size(); )
+        {
+            const Mesh &first = meshes[drawOrder[i]];
+            first.bindMaterial(shader);
+            for (; i < drawOrder.size() && meshes[drawOrder[i]].materialHash == first.materialHash; i++)
+            {
+                const Mesh &mesh = meshes[drawOrder[i]];
+                if (!batch.accepts(mesh, 1))
+                    batch.flush();
+                batch.add(mesh);
+            }
+            batch.flush();
+        }
+
+        GLState &gl = GLState::instance();
+        if (!gl.enabled)
+        {
+            gl.bindVertexArray(0);
+            gl.activeTexture(0);
+        }
+    }
+
+    // Repacks the material textures of the meshes into arrays, after which a material change is a uniform change and
+    // the textures stay bound from mesh to mesh (and from model to model, for models given the same arrays). The
+    // meshes' first texture of every type becomes a layer; arrays has to outlive the model and be built once every
+    // model using it was added; if build() fails, go back with useMeshTextures. Shaders sample the arrays as described
+    // in texture_array.h.
+    void useTextureArrays(MaterialTextureArrays &arrays)
+    {
+        for (Mesh &mesh : meshes)
+        {
+            glm::ivec4 layers(-1);
+            for (const Texture &texture : mesh.textures)
+            {
+                int type = MaterialTextureArrays::typeIndex(texture.type);
+                if (type >= 0 && layers[type] < 0)
+                    layers[type] = arrays.addLayer(type, directory + '/' + texture.path);
+            }
+            mesh.setTextureArrays(&arrays, layers);
+        }
+        sortDrawOrder();
+    }
+
+    // useTextureArrays with arrays of the model's own, returns false (and keeps the meshes' textures) if they can't be built
+    bool buildTextureArrays()
+    {
+        ownTextureArrays.reset(new MaterialTextureArrays(gammaCorrection));
+        useTextureArrays(*ownTextureArrays);
+        if (ownTextureArrays->build())
+            return true;
+        useMeshTextures();
+        ownTextureArrays.reset();
+        return false;
+    }
+
+    // binds each mesh's own textures again, e.g. after the arrays given to useTextureArrays failed to build
+    void useMeshTextures()
+    {
+        for (Mesh &mesh : meshes)
+            mesh.setTextureArrays(nullptr);
+        sortDrawOrder();
+    }
+
+    // multi-draws Draw(shader) issues, one per material and arena page the meshes use
+    unsigned int drawBatches() const
+    {
+        unsigned int batches = 0;
+        for (size_t i = 0; i < drawOrder.size(); i++)
+        {
+            const Mesh &mesh = meshes[drawOrder[i]];
+            if (i == 0)
+            {
+                batches++;
+                continue;
+            }
+            const Mesh &previous = meshes[drawOrder[i - 1]];
+            batches += mesh.materialHash != previous.materialHash || mesh.VAO != previous.VAO || mesh.indexType != previous.indexType;
+        }
+        return batches;
+    }
+
+    // levels of detail every mesh has
+    unsigned int lodCount() const
+    {
+        size_t count = meshes.empty() ? 1 : meshes[0].lods.size();
+        for (const Mesh &mesh : meshes)
+            count = min(count, mesh.lods.size());
+        return (unsigned int)count;
+    }
+
+    // largest error of level lod over the meshes, object space
+    float lodError(unsigned int lod) const
+    {
+        float error = 0.0f;
+        for (const Mesh &mesh : meshes)
+            if (lod < mesh.lods.size())
+                error = max(error, mesh.lods[lod].error);
+        return error;
+    }
+
+    // triangles level lod of the model draws
+    size_t lodTriangles(unsigned int lod) const
+    {
+        size_t triangles = 0;
+        for (const Mesh &mesh : meshes)
+            triangles += mesh.lods[min<size_t>(lod, mesh.lods.size() - 1)].indexCount / 3;
+        return triangles;
+    }
+
+    // queues all meshes with the same transform, meshes sharing a material end up next to each other once sorted
+    void Draw(RenderQueue &queue, Shader &shader, const glm::mat4 &model, RenderPass pass = RenderPass::Opaque, unsigned int instanceCount = 1) const
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            queue.submit(meshes[i], shader, model, pass, instanceCount);
     }
     
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // mesh indices grouped by material, then by what a DrawBatch can't mix
+    vector<unsigned int> drawOrder;
+    DrawBatch batch;
+    unique_ptr<MaterialTextureArrays> ownTextureArrays;
+
+    // loads a model from its mesh cache if there's a valid one, otherwise imports it through ASSIMP and writes the cache.
     void loadModel(string const &path)
+    {
+        auto start = chrono::steady_clock::now();
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        bool warm = loadCachedModel(path);
+        if (!warm)
+        {
+            if (!importModel(path))
+                return;
+            if (!writeMeshCache(path, meshes, importSettingsHash()))
+                cout << "WARNING::MODEL:: could not write mesh cache " << meshCachePath(path) << endl;
+            // the cache was the last user of the CPU-side data (a warm load only copies it out of the cache for KeepCPU)
+            if (retention == MeshRetention::DropAfterUpload)
+                for (Mesh &mesh : meshes)
+                    mesh.dropCPUData();
+        }
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "MODEL:: " << path << " loaded in " << ms << " ms (" << (warm ? "warm, mesh cache" : "cold, assimp") << ")" << endl;
+        size_t indexBytes = 0, shortMeshes = 0, vertexBytes = 0, cpuBytes = 0;
+        for (const Mesh &mesh : meshes)
+        {
+            indexBytes += mesh.indexBytes();
+            shortMeshes += mesh.indexType == GL_UNSIGNED_SHORT;
+            vertexBytes += mesh.vertexBytes();
+            cpuBytes += mesh.cpuBytes();
+        }
+        cout << "MODEL:: " << vertexBytes / 1024 << " KiB of vertex data, " << shortMeshes << "/" << meshes.size()
+             << " meshes with 16-bit indices, " << indexBytes / 1024 << " KiB of index data, " << cpuBytes / 1024
+             << " KiB kept in CPU memory" << endl;
+        sortDrawOrder();
+    }
+
+    // groups the meshes for Draw(shader) by material hash, then by arena page and index type
+    void sortDrawOrder()
+    {
+        drawOrder.resize(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            drawOrder[i] = i;
+        stable_sort(drawOrder.begin(), drawOrder.end(), [&](unsigned int a, unsigned int b)
+        {
+            const Mesh &meshA = meshes[a], &meshB = meshes[b];
+            if (meshA.materialHash != meshB.materialHash)
+                return meshA.materialHash < meshB.materialHash;
+            if (meshA.VAO != meshB.VAO)
+                return meshA.VAO < meshB.VAO;
+            return meshA.indexType < meshB.indexType;
+        });
+        cout << "MODEL:: " << meshes.size() << " meshes in " << drawBatches() << " draw batches" << endl;
+    }
+
+    // builds the meshes straight from a mapped mesh cache, returns false if there's no usable cache.
+    bool loadCachedModel(string const &path)
+    {
+        MappedFile file;
+        const MeshCacheHeader *header;
+        const MeshCacheEntry *entries;
+        const MeshCacheTexture *cachedTextures;
+        const MeshCacheLod *cachedLods;
+        if (!openMeshCache(path, importSettingsHash(), file, header, entries, cachedTextures, cachedLods))
+            return false;
+
+        meshes.reserve(header->meshCount);
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheEntry &entry = entries[i];
+            vector<Texture> textures;
+            for (uint32_t j = 0; j < entry.textureCount; j++)
+            {
+                const MeshCacheTexture &record = cachedTextures[entry.firstTexture + j];
+                textures.push_back(loadTexture(record.path, record.type));
+            }
+            // vertex and index data go from the mapping to the buffer objects without an intermediate copy, and are
+            // copied out of it as well only when the meshes keep them in CPU memory
+            meshes.emplace_back((VertexFormat)entry.vertexFormat, file.data + entry.vertexOffset, entry.vertexCount,
+                                reinterpret_cast<const unsigned int*>(file.data + entry.indexOffset), entry.indexCount,
+                                std::move(textures), entry.aabbMin, entry.aabbMax,
+                                vector<MeshLod>(cachedLods + entry.firstLod, cachedLods + entry.firstLod + entry.lodCount), arena,
+                                retention);
+        }
+        return true;
+    }
+
+    // imports a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    bool importModel(string const &path)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
@@ -58,84 +328,144 @@ private:
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        return true;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+    // processes the node tree: collects the meshes in a deterministic depth-first order, converts their CPU-side data on
+    // the shared thread pool and finally creates the GL buffers (and loads the textures) on the context thread in that same order.
     void processNode(aiNode *node, const aiScene *scene)
     {
-        // process each mesh located at the current node
+        vector<aiMesh*> sceneMeshes;
+        collectMeshes(node, scene, sceneMeshes);
+
+        vector<MeshData> meshData(sceneMeshes.size());
+        ThreadPool::shared().parallelFor(sceneMeshes.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                meshData[i] = processMesh(sceneMeshes[i], scene);
+        });
+
+        size_t importedVertices = 0, weldedVertices = 0;
+        double weldMs = 0.0;
+        for (const MeshData &data : meshData)
+        {
+            importedVertices += data.importedVertices;
+            weldedVertices += data.vertices.size();
+            weldMs += data.weldMs;
+        }
+        if (importedVertices > 0)
+            cout << "MODEL:: welded " << importedVertices << " -> " << weldedVertices << " vertices ("
+                 << 100.0 * (importedVertices - weldedVertices) / importedVertices << "% fewer) in " << weldMs << " ms" << endl;
+        VertexCacheStats cacheBefore, cacheAfter;
+        OverdrawStats overdrawBefore, overdrawAfter;
+        for (const MeshData &data : meshData)
+        {
+            cacheBefore += data.cacheBefore;
+            cacheAfter += data.cacheAfter;
+            overdrawBefore += data.overdrawBefore;
+            overdrawAfter += data.overdrawAfter;
+        }
+        if (cacheBefore.triangles > 0)
+            cout << "MODEL:: vertex cache ACMR " << cacheBefore.acmr() << " -> " << cacheAfter.acmr() << ", ATVR "
+                 << cacheBefore.atvr() << " -> " << cacheAfter.atvr() << ", overdraw " << overdrawBefore.overdraw()
+                 << " -> " << overdrawAfter.overdraw() << endl;
+
+        meshes.reserve(meshes.size() + meshData.size());
+        for (MeshData &data : meshData)
+        {
+            vector<Texture> textures;
+            for (const MeshTextureRef &ref : data.textures)
+                textures.push_back(loadTexture(ref.path.c_str(), ref.type));
+            // kept until the mesh cache is written, loadModel drops them afterwards if asked to
+            meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(textures), std::move(data.lods),
+                                data.format, arena, MeshRetention::KeepCPU);
+            const Mesh &mesh = meshes.back();
+            if (vertexFormatQuantized(mesh.vertexFormat))
+            {
+                QuantizationError error = measureQuantizationError(mesh.vertexFormat, mesh.vertices.data(), mesh.vertices.size(), mesh.positionDecode);
+                cout << "MODEL:: mesh " << meshes.size() - 1 << " quantized to " << vertexFormatSize(mesh.vertexFormat)
+                     << " bytes per vertex, max position error " << error.position << " ("
+                     << 100.0f * error.position / glm::length(mesh.aabbMax - mesh.aabbMin) << "% of the diagonal), max normal error "
+                     << error.normal << " degrees" << endl;
+            }
+        }
+    }
+
+    // walks a node in a recursive fashion, appending each individual mesh located at the node and then the ones of its children nodes (if any).
+    void collectMeshes(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes)
+    {
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            collectMeshes(node->mChildren[i], scene, sceneMeshes);
         }
-
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // converts an aiMesh to our vertex/index layout and gathers its material texture paths.
+    // runs on a worker thread: reads the scene only and must not touch GL or the model's members.
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vertices.resize(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
+
+        // walk through each of the mesh's vertices, big single-mesh models (the planets) are split across the pool as well
+        ThreadPool::shared().parallelFor(mesh->mNumVertices, 16384, [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                Vertex &vertex = vertices[i];
+                glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+                // positions
+                vector.x = mesh->mVertices[i].x;
+                vector.y = mesh->mVertices[i].y;
+                vector.z = mesh->mVertices[i].z;
+                vertex.Position = vector;
+                // normals
+                if (mesh->HasNormals())
+                {
+                    vector.x = mesh->mNormals[i].x;
+                    vector.y = mesh->mNormals[i].y;
+                    vector.z = mesh->mNormals[i].z;
+                    vertex.Normal = vector;
+                }
+                // texture coordinates
+                if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+                {
+                    glm::vec2 vec;
+                    // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+                    // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+                    vec.x = mesh->mTextureCoords[0][i].x; 
+                    vec.y = mesh->mTextureCoords[0][i].y;
+                    vertex.TexCoords = vec;
+                    // tangent
+                    vector.x = mesh->mTangents[i].x;
+                    vector.y = mesh->mTangents[i].y;
+                    vector.z = mesh->mTangents[i].z;
+                    vertex.Tangent = vector;
+                    // bitangent
+                    vector.x = mesh->mBitangents[i].x;
+                    vector.y = mesh->mBitangents[i].y;
+                    vector.z = mesh->mBitangents[i].z;
+                    vertex.Bitangent = vector;
+                }
+                else
+                    vertex.TexCoords = glm::vec2(0.0f, 0.0f);
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
-        }
+        });
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
@@ -144,8 +474,33 @@ private:
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);        
         }
+        // the vertex format: bone data only for skinned meshes, the tangent frame only where a normal or height map
+        // needs it. Attributes the format drops are cleared so they don't keep vertices apart when welding.
+        aiMaterial *meshMaterial = scene->mMaterials[mesh->mMaterialIndex];
+        bool normalMapped = meshMaterial->GetTextureCount(aiTextureType_HEIGHT) > 0 || meshMaterial->GetTextureCount(aiTextureType_AMBIENT) > 0;
+        if (mesh->HasBones())
+            data.format = VertexFormat::Skinned;
+        else if (mesh->HasTangentsAndBitangents() && normalMapped && tangentFrame)
+            data.format = VertexFormat::Tangent;
+        else
+            data.format = VertexFormat::Basic;
+        if (data.format == VertexFormat::Basic)
+            for (Vertex &vertex : vertices)
+                vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+        if (quantizeVertices)
+            data.format = quantizedVertexFormat(data.format);
+        // merge the vertices the importer split per face corner, before the levels of detail so they simplify across them
+        auto weldStart = chrono::steady_clock::now();
+        data.importedVertices = vertices.size();
+        VertexWelder::weld(vertices, indices, weldTolerance);
+        data.weldMs = chrono::duration<double, milli>(chrono::steady_clock::now() - weldStart).count();
+        // levels of detail, appended to the indices
+        buildLods(data);
+        // triangle and vertex order for the GPU
+        optimizeMesh(data);
+
         // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
+        aiMaterial* material = meshMaterial;
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
@@ -154,94 +509,116 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
+
+        // return the extracted mesh data, the Mesh itself is created on the context thread
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // the settings the meshes' data depends on beyond the source asset, a mesh cache built with others is stale
+    uint64_t importSettingsHash() const
+    {
+        // FNV-1a of the weld tolerances and the vertex format flags continued from the LOD hash
+        uint64_t hash = lodLevelsHash(lodLevels);
+        const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&weldTolerance);
+        for (size_t i = 0; i < sizeof(WeldTolerance); i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        hash = (hash ^ (uint64_t)quantizeVertices) * 1099511628211ull;
+        return (hash ^ (uint64_t)tangentFrame) * 1099511628211ull;
+    }
+
+    // simplifies the full mesh once per LOD level and appends each level's indices after the previous ones.
+    // runs on a worker thread along with processMesh.
+    void buildLods(MeshData &data) const
+    {
+        size_t fullCount = data.indices.size();
+        data.lods.push_back(MeshLod{0, (unsigned int)fullCount, 0.0f});
+        if (lodLevels.empty() || fullCount == 0)
+            return;
+
+        vector<unsigned int> full(data.indices.begin(), data.indices.end());
+        float radius = MeshSimplifier::boundingRadius(data.vertices.data(), data.vertices.size());
+        for (const LodLevel &level : lodLevels)
+        {
+            size_t target = (size_t)(fullCount / 3 * level.ratio) * 3;
+            float error = 0.0f;
+            vector<unsigned int> simplified = MeshSimplifier::simplify(data.vertices.data(), data.vertices.size(), full,
+                                                                       target, level.maxError * radius, &error);
+            data.lods.push_back(MeshLod{(unsigned int)data.indices.size(), (unsigned int)simplified.size(), error});
+            data.indices.insert(data.indices.end(), simplified.begin(), simplified.end());
+        }
+    }
+
+    // reorders the triangles of every level for the vertex cache and overdraw, then the vertices for fetch locality.
+    // runs on a worker thread along with processMesh.
+    static void optimizeMesh(MeshData &data)
+    {
+        const MeshLod &full = data.lods[0];
+        data.cacheBefore = MeshOptimizer::analyzeVertexCache(data.indices.data() + full.firstIndex, full.indexCount, data.vertices.size());
+        data.overdrawBefore = MeshOptimizer::analyzeOverdraw(data.indices.data() + full.firstIndex, full.indexCount,
+                                                             data.vertices.data(), data.vertices.size());
+        for (const MeshLod &lod : data.lods)
+        {
+            vector<size_t> clusters;
+            MeshOptimizer::optimizeVertexCache(data.indices, lod.firstIndex, lod.indexCount, data.vertices.size(), &clusters);
+            MeshOptimizer::optimizeOverdraw(data.indices, lod.firstIndex, lod.indexCount, data.vertices.data(),
+                                            data.vertices.size(), clusters);
+        }
+        MeshOptimizer::optimizeVertexFetch(data.vertices, data.indices);
+        data.cacheAfter = MeshOptimizer::analyzeVertexCache(data.indices.data() + full.firstIndex, full.indexCount, data.vertices.size());
+        data.overdrawAfter = MeshOptimizer::analyzeOverdraw(data.indices.data() + full.firstIndex, full.indexCount,
+                                                            data.vertices.data(), data.vertices.size());
+    }
+
+    // appends the paths of all material textures of a given type; they're loaded later on the context thread.
+    static void collectMaterialTextures(aiMaterial *mat, aiTextureType type, const string &typeName, vector<MeshTextureRef> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back({typeName, str.C_Str()});
         }
-        return textures;
     }
+
+    // loads the texture at path (relative to the model directory) unless it was loaded before.
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        // check if this model uses the texture already and if so, reuse it: skip acquiring it again
+        auto it = textureIndices.find(path);
+        if (it != textureIndices.end())
+        {
+            Texture texture = textures_loaded[it->second];
+            texture.type = typeName;
+            return texture;
+        }
+        // otherwise get it from the registry, which only decodes it if no other model or demo loaded it before
+        Texture texture;
+        texture.id = TextureFromFile(path, this->directory, gammaCorrection);
+        texture.type = typeName;
+        texture.path = path;
+        textureIndices[texture.path] = textures_loaded.size();
+        textures_loaded.push_back(texture);
+        return texture;
+    }
+
+    // position of each texture path in textures_loaded
+    unordered_map<string, size_t> textureIndices;
 };
 
 
+// loads path (relative to directory) through the process-wide texture registry, the caller owns one reference
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename, gamma);
 }
 #endif
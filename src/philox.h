@@ -0,0 +1,102 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"): a counter based generator, the
+// random numbers are a pure function of (counter, key). Giving every item its own counter makes the output
+// independent of the order and the thread it is generated on, with no generator state to share or split.
+class Philox {
+public:
+    // the 4 random words of counter under key
+    static void block(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+    {
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            uint64_t product0 = (uint64_t)M0 * c0;
+            uint64_t product1 = (uint64_t)M1 * c2;
+            uint32_t next0 = (uint32_t)(product1 >> 32) ^ c1 ^ k0;
+            uint32_t next2 = (uint32_t)(product0 >> 32) ^ c3 ^ k1;
+            c1 = (uint32_t)product1;
+            c3 = (uint32_t)product0;
+            c0 = next0;
+            c2 = next2;
+            k0 += W0;
+            k1 += W1;
+        }
+        out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+    }
+
+    // the blocks of the 4 counters {first + lane, counter1, counter2, counter3}; out[word][lane], same values as
+    // block() would give lane by lane
+    static void block4(uint32_t first, uint32_t counter1, uint32_t counter2, uint32_t counter3, const uint32_t key[2], uint32_t out[4][4])
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i c0 = _mm_add_epi32(_mm_set1_epi32((int)first), _mm_set_epi32(3, 2, 1, 0));
+        __m128i c1 = _mm_set1_epi32((int)counter1), c2 = _mm_set1_epi32((int)counter2), c3 = _mm_set1_epi32((int)counter3);
+        __m128i m0 = _mm_set1_epi32((int)M0), m1 = _mm_set1_epi32((int)M1);
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            __m128i high0, low0, high1, low1;
+            multiply(c0, m0, high0, low0);
+            multiply(c2, m1, high1, low1);
+            __m128i next0 = _mm_xor_si128(_mm_xor_si128(high1, c1), _mm_set1_epi32((int)k0));
+            __m128i next2 = _mm_xor_si128(_mm_xor_si128(high0, c3), _mm_set1_epi32((int)k1));
+            c1 = low1;
+            c3 = low0;
+            c0 = next0;
+            c2 = next2;
+            k0 += W0;
+            k1 += W1;
+        }
+        _mm_storeu_si128((__m128i*)out[0], c0);
+        _mm_storeu_si128((__m128i*)out[1], c1);
+        _mm_storeu_si128((__m128i*)out[2], c2);
+        _mm_storeu_si128((__m128i*)out[3], c3);
+#else
+        for (uint32_t lane = 0; lane < 4; lane++)
+        {
+            uint32_t counter[4] = {first + lane, counter1, counter2, counter3}, words[4];
+            block(counter, key, words);
+            for (int word = 0; word < 4; word++)
+                out[word][lane] = words[word];
+        }
+#endif
+    }
+
+    // seed as a key
+    static void key(uint64_t seed, uint32_t out[2])
+    {
+        out[0] = (uint32_t)seed;
+        out[1] = (uint32_t)(seed >> 32);
+    }
+
+    // uniform in [0, 1) from the top 24 bits, exact in a float
+    static float unit(uint32_t word) { return (float)(word >> 8) * (1.0f / 16777216.0f); }
+
+private:
+    static const int ROUNDS = 10;
+    static const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    static const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    // full 32x32 -> 64 bit products of the 4 lanes, split in high and low words
+    static void multiply(__m128i a, __m128i m, __m128i &high, __m128i &low)
+    {
+        __m128i even = _mm_mul_epu32(a, m);                      // lanes 0 and 2 as 64-bit products
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);   // lanes 1 and 3
+        even = _mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 2, 0)); // low0 low2 high0 high2
+        odd = _mm_shuffle_epi32(odd, _MM_SHUFFLE(3, 1, 2, 0));   // low1 low3 high1 high3
+        low = _mm_unpacklo_epi32(even, odd);
+        high = _mm_unpackhi_epi32(even, odd);
+    }
+#endif
+};
+#endif
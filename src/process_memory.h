@@ -0,0 +1,66 @@
+#ifndef PROCESS_MEMORY_H
+#define PROCESS_MEMORY_H
+
+#include <cstddef>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <cstdio>
+#include <cstring>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// resident set size of the process, now and at its peak; 0 where the platform doesn't tell
+struct ProcessMemory {
+    size_t residentBytes = 0;
+    size_t peakResidentBytes = 0;
+
+    static ProcessMemory query()
+    {
+        ProcessMemory memory;
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            memory.residentBytes = counters.WorkingSetSize;
+            memory.peakResidentBytes = counters.PeakWorkingSetSize;
+        }
+#elif defined(__linux__)
+        // VmRSS and VmHWM (the high water mark), in kB
+        FILE *status = fopen("/proc/self/status", "r");
+        if (status)
+        {
+            char line[256];
+            while (fgets(line, sizeof(line), status))
+            {
+                size_t kilobytes = 0;
+                if (sscanf(line, "VmRSS: %zu kB", &kilobytes) == 1)
+                    memory.residentBytes = kilobytes * 1024;
+                else if (sscanf(line, "VmHWM: %zu kB", &kilobytes) == 1)
+                    memory.peakResidentBytes = kilobytes * 1024;
+            }
+            fclose(status);
+        }
+#else
+        // only the peak is available, in bytes on macOS
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            memory.peakResidentBytes = (size_t)usage.ru_maxrss;
+#endif
+        return memory;
+    }
+
+    static void print(const char *when)
+    {
+        ProcessMemory memory = query();
+        cout << "MEMORY:: " << when << ": " << memory.residentBytes / (1024 * 1024) << " MiB resident, peak "
+             << memory.peakResidentBytes / (1024 * 1024) << " MiB" << endl;
+    }
+};
+#endif
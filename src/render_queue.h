@@ -0,0 +1,229 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "draw_batch.h"
+#include "gl_state.h"
+#include "mesh.h"
+#include "shader.h"
+
+using namespace std;
+
+// blended draws come after every opaque one
+enum class RenderPass : unsigned char { Opaque = 0, Blended = 1 };
+
+// Collects the draws of a frame and issues them in an order that needs as few state changes as possible.
+// Every submission becomes a 64-bit sort key plus the index of its payload:
+//     opaque:  pass(2) | program(10) | material(14) | vao(14) | depth(24)    grouped by state, then front to back
+//     blended: pass(2) | ~depth(24) | program(10) | material(14) | vao(14)   back to front, state only breaks ties
+// flush() radix sorts the keys and walks them, rebinding program, textures and VAO only where they change (GLState
+// drops whatever is still redundant). Consecutive draws that share all of that plus their model matrix and instance
+// count (the meshes of one model with the same material, typically) are merged into one DrawBatch multi-draw. Programs, materials and VAOs get small ids on first sight; ids beyond a field's
+// range wrap around, which only costs batching, never correctness, since flush compares the real objects.
+class RenderQueue {
+public:
+    // camera distances mapped onto the 24 depth bits, anything outside is clamped
+    float nearDistance = 0.1f;
+    float farDistance = 1000.0f;
+
+    // what the last flush issued, draws counts GL draw calls for the meshes submitted
+    unsigned int meshes = 0;
+    unsigned int draws = 0;
+    unsigned int programChanges = 0;
+    unsigned int materialChanges = 0;
+    unsigned int vertexArrayChanges = 0;
+    unsigned long long triangles = 0;
+
+    // world space camera position the depth of the submissions is measured from
+    void setViewer(const glm::vec3 &position) { viewer = position; }
+
+    // queues mesh to be drawn with shader, model goes to the shader's "model" and "normalMatrix" uniforms (if it has them)
+    void submit(const Mesh &mesh, Shader &shader, const glm::mat4 &model, RenderPass pass = RenderPass::Opaque, unsigned int instanceCount = 1)
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4((mesh.aabbMin + mesh.aabbMax) * 0.5f, 1.0f));
+        float t = (glm::length(center - viewer) - nearDistance) / (farDistance - nearDistance);
+        uint64_t depth = (uint64_t)(glm::clamp(t, 0.0f, 1.0f) * DEPTH_MASK);
+
+        uint64_t program  = intern(programIds, shader.ID, PROGRAM_MASK);
+        uint64_t material = intern(materialIds, mesh.materialHash, MATERIAL_MASK);
+        uint64_t vao      = intern(vertexArrayIds, mesh.VAO, VAO_MASK);
+        uint64_t state = program << 28 | material << 14 | vao;
+
+        uint64_t key;
+        if (pass == RenderPass::Opaque)
+            key = state << 24 | depth;
+        else
+            key = (uint64_t)pass << 62 | (DEPTH_MASK - depth) << 38 | state;
+
+        entries.push_back(SortEntry{key, (uint32_t)items.size()});
+        items.push_back(DrawItem{&mesh, &shader, model, instanceCount});
+    }
+
+    size_t size() const { return items.size(); }
+
+    // sorts and draws everything submitted since the last flush, then empties the queue.
+    // GL_BLEND is managed here: off for the opaque pass, alpha blending for the blended one, off again afterwards.
+    void flush()
+    {
+        meshes = draws = programChanges = materialChanges = vertexArrayChanges = 0;
+        triangles = 0;
+        radixSort();
+
+        Shader *program = nullptr;
+        const Mesh *materialMesh = nullptr;
+        unsigned int vao = 0;
+        bool blending = false;
+        const DrawItem *batched = nullptr;
+        for (const SortEntry &entry : entries)
+        {
+            const DrawItem &item = items[entry.item];
+            bool blended = (entry.key >> 62) == (uint64_t)RenderPass::Blended;
+            bool joins = batched && blended == blending && item.shader == program
+                && item.mesh->materialHash == materialMesh->materialHash && item.model == batched->model
+                && batch.accepts(*item.mesh, item.instanceCount);
+            if (!joins)
+            {
+                draws += batch.flush();
+                if (blended != blending)
+                {
+                    if (blended)
+                    {
+                        glEnable(GL_BLEND);
+                        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    }
+                    else
+                        glDisable(GL_BLEND);
+                    blending = blended;
+                }
+                if (item.shader != program)
+                {
+                    item.shader->use();
+                    program = item.shader;
+                    materialMesh = nullptr; // sampler uniforms are per program
+                    programChanges++;
+                }
+                if (!materialMesh || materialMesh->materialHash != item.mesh->materialHash)
+                {
+                    item.mesh->bindMaterial(*item.shader);
+                    materialMesh = item.mesh;
+                    materialChanges++;
+                }
+                if (item.mesh->VAO != vao)
+                {
+                    vao = item.mesh->VAO;
+                    vertexArrayChanges++;
+                }
+                item.shader->setMat4f(MODEL_UNIFORM, glm::value_ptr(item.model));
+                if (item.shader->getLocation(NORMAL_MATRIX_UNIFORM) >= 0)
+                    item.shader->setMat3(NORMAL_MATRIX_UNIFORM, glm::value_ptr(normalMatrix(item.model)));
+                batched = &item;
+            }
+            batch.add(*item.mesh, 0, item.instanceCount);
+            meshes++;
+            triangles += (unsigned long long)item.mesh->indexCount / 3 * item.instanceCount;
+        }
+        draws += batch.flush();
+        if (blending)
+            glDisable(GL_BLEND);
+
+        items.clear();
+        entries.clear();
+    }
+
+    void printStats() const
+    {
+        cout << "RENDER_QUEUE:: " << meshes << " meshes in " << draws << " draws, " << programChanges << " program, " << materialChanges
+             << " material, " << vertexArrayChanges << " vao changes, " << triangles << " triangles" << endl;
+    }
+
+private:
+    static const uint64_t DEPTH_MASK    = (1ull << 24) - 1;
+    static const uint64_t PROGRAM_MASK  = (1ull << 10) - 1;
+    static const uint64_t MATERIAL_MASK = (1ull << 14) - 1;
+    static const uint64_t VAO_MASK      = (1ull << 14) - 1;
+    static constexpr UniformId MODEL_UNIFORM = "model"_uniform;
+    static constexpr UniformId NORMAL_MATRIX_UNIFORM = "normalMatrix"_uniform;
+
+    struct DrawItem {
+        const Mesh *mesh;
+        Shader *shader;
+        glm::mat4 model;
+        unsigned int instanceCount;
+    };
+    struct SortEntry {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    glm::vec3 viewer = glm::vec3(0.0f);
+    DrawBatch batch;
+    vector<DrawItem> items;
+    vector<SortEntry> entries;
+    vector<SortEntry> scratch;
+    unordered_map<uint64_t, uint64_t> programIds;
+    unordered_map<uint64_t, uint64_t> materialIds;
+    unordered_map<uint64_t, uint64_t> vertexArrayIds;
+
+    // small id of value, handed out in order of first appearance
+    static uint64_t intern(unordered_map<uint64_t, uint64_t> &ids, uint64_t value, uint64_t mask)
+    {
+        auto it = ids.find(value);
+        if (it == ids.end())
+            it = ids.emplace(value, ids.size() & mask).first;
+        return it->second;
+    }
+
+    // LSD radix sort on the keys, a byte per pass. Stable, so equal keys keep their submission order; passes over a
+    // byte all keys share (most of them, with few programs and materials) are skipped.
+    void radixSort()
+    {
+        size_t count = entries.size();
+        if (count < 2)
+            return;
+        scratch.resize(count);
+        SortEntry *source = entries.data();
+        SortEntry *target = scratch.data();
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for (size_t i = 0; i < count; i++)
+                offsets[(source[i].key >> shift) & 0xff]++;
+            if (offsets[(source[0].key >> shift) & 0xff] == count)
+                continue;
+
+            size_t offset = 0;
+            for (unsigned int bucket = 0; bucket < 256; bucket++)
+            {
+                size_t bucketSize = offsets[bucket];
+                offsets[bucket] = offset;
+                offset += bucketSize;
+            }
+            for (size_t i = 0; i < count; i++)
+                target[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+            swap(source, target);
+        }
+        if (source != entries.data())
+            copy(source, source + count, entries.data());
+    }
+};
+
+inline void Mesh::Draw(RenderQueue &queue, Shader &shader, const glm::mat4 &model) const
+{
+    queue.submit(*this, shader, model);
+}
+
+inline void Mesh::Draw(RenderQueue &queue, Shader &shader, const glm::mat4 &model, RenderPass pass, unsigned int instanceCount) const
+{
+    queue.submit(*this, shader, model, pass, instanceCount);
+}
+#endif
@@ -1,74 +1,160 @@
 #include "shader.h"
+#include "gl_ext.h"
+#include "gl_state.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath){
-    // 1. retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
+// directory (relative to the working directory) holding the program binaries
+static const char* PROGRAM_CACHE_DIR = "shader_cache";
+
+// reads a whole shader source file, prints an error and returns an empty string on failure
+static std::string readShaderFile(const char* path)
+{
+    std::ifstream shaderFile;
     // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    shaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
     try
     {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        // read file’s buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        shaderFile.open(path);
+        std::stringstream shaderStream;
+        // read file’s buffer contents into stream
+        shaderStream << shaderFile.rdbuf();
+        shaderFile.close();
+        return shaderStream.str();
     }
-    catch(std::ifstream::failure e)
+    catch(std::ifstream::failure &e)
     {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
     }
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
-    
-    unsigned int vertex, fragment;
+    return std::string();
+}
+
+// 64-bit FNV-1a, continued from hash
+static uint64_t hashBytes(const std::string &bytes, uint64_t hash = 14695981039346656037ull)
+{
+    for (unsigned char c : bytes)
+        hash = (hash ^ c) * 1099511628211ull;
+    // separator so ("ab", "c") and ("a", "bc") hash differently
+    return (hash ^ 0xff) * 1099511628211ull;
+}
+
+static unsigned int compileStage(GLenum type, const std::string &code, const char* stageName)
+{
+    const char* shaderCode = code.c_str();
     int success;
     char infoLog[512];
-    
-    // vertex Shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    
+
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &shaderCode, NULL);
+    glCompileShader(shader);
+
     // print compile errors if any
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if(!success)
     {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" <<
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << stageName << "::COMPILATION_FAILED\n" <<
         infoLog << std::endl;
     };
+    return shader;
+}
 
-    // Fragment Shader
+// inserts the defines right after the #version directive, which has to stay the first statement of the source
+static std::string injectDefines(const std::string &code, const ShaderDefines &defines)
+{
+    if (code.empty() || defines.empty())
+        return code;
+    std::string block;
+    for (const auto &define : defines)
+        block += "#define " + define.first + " " + define.second + "\n";
 
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode,NULL);
-    glCompileShader(fragment);
+    size_t version = code.find("#version");
+    if (version == std::string::npos)
+        return block + "#line 0\n" + code;
+    size_t lineEnd = code.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return code + "\n" + block;
+    // renumber so compile errors still report the line numbers of the file (GLSL 3.30: the line after "#line N" is N + 1)
+    int versionLine = 1;
+    for (size_t i = 0; i < version; i++)
+        if (code[i] == '\n')
+            versionLine++;
+    return code.substr(0, lineEnd + 1) + block + "#line " + std::to_string(versionLine) + "\n" + code.substr(lineEnd + 1);
+}
 
-    // print compile errors if any
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" <<
-        infoLog << std::endl;
-    };
+Shader::Shader(const char* vertexPath, const char* fragmentPath)
+    : Shader(vertexPath, nullptr, fragmentPath)
+{
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines)
+    : Shader(vertexPath, nullptr, fragmentPath, defines)
+{
+}
+
+Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath, const ShaderDefines &defines){
+    build(vertexPath, geometryPath, fragmentPath, defines);
+}
+
+Shader::Shader(const char* vertexPath, const char* geometryPath, const std::vector<std::string> &feedbackVaryings, const ShaderDefines &defines)
+    : feedbackVaryings(feedbackVaryings)
+{
+    build(vertexPath, geometryPath, nullptr, defines);
+}
+
+void Shader::build(const char* vertexPath, const char* geometryPath, const char* fragmentPath, const ShaderDefines &defines){
+    // 1. retrieve the vertex/geometry/fragment source code from filePath and specialize it with the defines
+    std::string vertexCode = injectDefines(readShaderFile(vertexPath), defines);
+    std::string geometryCode = geometryPath ? injectDefines(readShaderFile(geometryPath), defines) : std::string();
+    std::string fragmentCode = fragmentPath ? injectDefines(readShaderFile(fragmentPath), defines) : std::string();
+
+    auto start = std::chrono::steady_clock::now();
+    // 2. reuse the program binary of a previous run if the driver still accepts it, compile from source otherwise
+    bool cached = loadProgramBinary(vertexCode, geometryCode, fragmentCode);
+    if (!cached)
+        compileAndLink(vertexCode, geometryCode, fragmentCode);
+
+    reflectUniforms();
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "SHADER:: " << vertexPath << (geometryPath ? " + " : "") << (geometryPath ? geometryPath : "")
+              << (fragmentPath ? " + " : " (transform feedback)") << (fragmentPath ? fragmentPath : "");
+    if (!defines.empty())
+        std::cout << " [" << ShaderVariants::key(defines) << "]";
+    std::cout << (cached ? " loaded from program binary cache in " : " compiled in ") << ms << " ms" << std::endl;
+}
+
+void Shader::compileAndLink(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode)
+{
+    unsigned int vertex = compileStage(GL_VERTEX_SHADER, vertexCode, "VERTEX");
+    unsigned int geometry = geometryCode.empty() ? 0 : compileStage(GL_GEOMETRY_SHADER, geometryCode, "GEOMETRY");
+    unsigned int fragment = fragmentCode.empty() ? 0 : compileStage(GL_FRAGMENT_SHADER, fragmentCode, "FRAGMENT");
 
-    ID = glCreateProgram();
+    int success;
+    char infoLog[512];
+    program = GpuProgram::create();
+    ID = program.id();
     glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
+    if (geometry)
+        glAttachShader(ID, geometry);
+    if (fragment)
+        glAttachShader(ID, fragment);
+    // captured outputs have to be known at link time
+    if (!feedbackVaryings.empty())
+    {
+        std::vector<const char*> names;
+        for (const std::string &name : feedbackVaryings)
+            names.push_back(name.c_str());
+        glTransformFeedbackVaryings(ID, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+    GLExtensions &ext = glExtensions();
+    if (ext.programBinary)
+        ext.ProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);
     // print linking errors if any
     glGetProgramiv(ID, GL_LINK_STATUS, &success);
@@ -80,28 +166,333 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath){
     }
     // delete shaders; they’re linked into our program and no longer necessary
     glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    if (geometry)
+        glDeleteShader(geometry);
+    if (fragment)
+        glDeleteShader(fragment);
+
+    if (success)
+        saveProgramBinary(vertexCode, geometryCode, fragmentCode);
+}
+
+// cache file of a program: keyed by its (define-injected) sources, captured outputs and by the driver, since binaries are only valid for the driver that made them
+std::string Shader::programCachePath(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode) const
+{
+    uint64_t hash = hashBytes(vertexCode);
+    hash = hashBytes(geometryCode, hash);
+    hash = hashBytes(fragmentCode, hash);
+    for (const std::string &name : feedbackVaryings)
+        hash = hashBytes(name, hash);
+    hash = hashBytes(reinterpret_cast<const char*>(glGetString(GL_VENDOR)), hash);
+    hash = hashBytes(reinterpret_cast<const char*>(glGetString(GL_RENDERER)), hash);
+    hash = hashBytes(reinterpret_cast<const char*>(glGetString(GL_VERSION)), hash);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return std::string(PROGRAM_CACHE_DIR) + "/" + name;
+}
+
+bool Shader::loadProgramBinary(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode)
+{
+    GLExtensions &ext = glExtensions();
+    if (!ext.programBinary)
+        return false;
+
+    std::ifstream file(programCachePath(vertexCode, geometryCode, fragmentCode), std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    std::streamoff size = file.tellg();
+    if (size <= (std::streamoff)sizeof(GLenum))
+        return false;
+    file.seekg(0);
+    GLenum format = 0;
+    std::vector<char> binary((size_t)size - sizeof(format));
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    file.read(binary.data(), binary.size());
+    if (!file)
+        return false;
+
+    program = GpuProgram::create();
+    ID = program.id();
+    ext.ProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
+    int success;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // driver update or corrupted file: throw it away and let the caller compile from source
+        program.reset();
+        ID = 0;
+        return false;
+    }
+    return true;
+}
+
+void Shader::saveProgramBinary(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode)
+{
+    GLExtensions &ext = glExtensions();
+    if (!ext.programBinary)
+        return;
+
+    int length = 0;
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    ext.GetProgramBinary(ID, length, NULL, &format, binary.data());
+
+#ifdef _WIN32
+    _mkdir(PROGRAM_CACHE_DIR);
+#else
+    mkdir(PROGRAM_CACHE_DIR, 0755);
+#endif
+    std::string path = programCachePath(vertexCode, geometryCode, fragmentCode);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(binary.data(), binary.size());
+        if (!file)
+        {
+            // disk full or not writable: don't leave the partial file behind
+            file.close();
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str()); // rename() doesn't replace an existing file there
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        std::remove(tmpPath.c_str());
+}
+
+
+// builds the uniform location table once after linking so the setters never have to ask the driver
+void Shader::reflectUniforms()
+{
+    int count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<std::pair<std::string, int>> uniforms;
+    std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+    for (int i = 0; i < count; i++)
+    {
+        int size = 0;
+        GLenum type;
+        glGetActiveUniform(ID, i, (GLsizei)nameBuffer.size(), NULL, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data());
+        // arrays are reported once as "name[0]": register the bare name and every element
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        {
+            std::string base = name.substr(0, name.size() - 3);
+            uniforms.push_back(std::make_pair(base, glGetUniformLocation(ID, base.c_str())));
+            for (int element = 0; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                uniforms.push_back(std::make_pair(elementName, glGetUniformLocation(ID, elementName.c_str())));
+            }
+        }
+        else
+            uniforms.push_back(std::make_pair(name, glGetUniformLocation(ID, name.c_str())));
+    }
+
+    // power of two with a load factor of at most 1/2, every array element counts as its own entry
+    size_t capacity = 16;
+    while (capacity < uniforms.size() * 2)
+        capacity *= 2;
+    uniformSlots.assign(capacity, UniformSlot{0, EMPTY_SLOT});
+    uniformNames.assign(capacity, std::string());
+    for (const auto &uniform : uniforms)
+        if (uniform.second >= 0)
+            insertUniform(uniform.first, uniform.second);
+}
+
+void Shader::insertUniform(const std::string &name, int location)
+{
+    uint32_t hash = uniformHash(name.c_str(), name.size());
+    size_t mask = uniformSlots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        if (uniformSlots[i].location == EMPTY_SLOT)
+        {
+            uniformSlots[i] = UniformSlot{hash, location};
+            uniformNames[i] = name;
+            return;
+        }
+        if (uniformSlots[i].hash == hash)
+        {
+            // two uniforms behind one hash: neither may be set through it, or one would silently receive the other's
+            // values. The string setters resolve them by name instead.
+            if (uniformNames[i] != name && uniformSlots[i].location != COLLIDING_SLOT)
+            {
+                std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION " << uniformNames[i] << " and " << name
+                          << " of program " << ID << ", set them by name" << std::endl;
+                uniformSlots[i].location = COLLIDING_SLOT;
+            }
+            return;
+        }
+    }
+}
+
+size_t Shader::findSlot(uint32_t hash) const
+{
+    if (uniformSlots.empty())
+        return SIZE_MAX;
+    size_t mask = uniformSlots.size() - 1;
+    for (size_t i = hash & mask; uniformSlots[i].location != EMPTY_SLOT; i = (i + 1) & mask)
+    {
+        if (uniformSlots[i].hash == hash)
+            return i;
+    }
+    return SIZE_MAX;
+}
+
+int Shader::getLocation(UniformId name) const
+{
+    size_t slot = findSlot(name.hash);
+    return slot == SIZE_MAX || uniformSlots[slot].location == COLLIDING_SLOT ? -1 : uniformSlots[slot].location;
+}
+
+int Shader::getLocation(const std::string &name) const
+{
+    size_t slot = findSlot(uniformHash(name.c_str(), name.size()));
+    if (slot == SIZE_MAX)
+        return -1;
+    if (uniformSlots[slot].location == COLLIDING_SLOT)
+        return glGetUniformLocation(ID, name.c_str());
+    // a name that isn't active but hashes like one that is
+    return uniformNames[slot] == name ? uniformSlots[slot].location : -1;
+}
+
+Shader::Shader(Shader &&other) noexcept
+    : ID(other.ID), uniformSlots(std::move(other.uniformSlots)), uniformNames(std::move(other.uniformNames)), feedbackVaryings(std::move(other.feedbackVaryings)),
+      program(std::move(other.program))
+{
+    other.ID = 0;
+}
+
+Shader& Shader::operator=(Shader &&other) noexcept
+{
+    if (this != &other)
+    {
+        ID = other.ID;
+        uniformSlots = std::move(other.uniformSlots);
+        uniformNames = std::move(other.uniformNames);
+        feedbackVaryings = std::move(other.feedbackVaryings);
+        program = std::move(other.program);
+        other.ID = 0;
+    }
+    return *this;
 }
 
 void Shader::use(){
-    glUseProgram(ID);
+    GLState::instance().useProgram(ID);
 }
 
-// Uniform setter functions
+// Uniform setter functions, writes of the value a location already holds are dropped by GLState
 
 void Shader::setBool(const std::string &name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    GLState::instance().uniform1i(ID, getLocation(name), (int)value);
 }
 void Shader::setInt(const std::string &name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    GLState::instance().uniform1i(ID, getLocation(name), value);
 }
 void Shader::setFloat(const std::string &name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    GLState::instance().uniform1f(ID, getLocation(name), value);
+}
+void Shader::setVec2(const std::string &name, const float * value) const
+{
+    GLState::instance().uniform2fv(ID, getLocation(name), value);
+}
+void Shader::setVec3(const std::string &name, const float * value) const
+{
+    GLState::instance().uniform3fv(ID, getLocation(name), value);
+}
+void Shader::setVec4(const std::string &name, const float * value, int count) const
+{
+    GLState::instance().uniform4fv(ID, getLocation(name), value, count);
+}
+void Shader::setIVec4(const std::string &name, const int * value) const
+{
+    GLState::instance().uniform4iv(ID, getLocation(name), value);
+}
+void Shader::setMat3(const std::string &name, const float * value) const
+{
+    GLState::instance().uniformMatrix3fv(ID, getLocation(name), value);
 }
 void Shader::setMat4f(const std::string &name, const float * value) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()),1, GL_FALSE, value);
-}
\ No newline at end of file
+    GLState::instance().uniformMatrix4fv(ID, getLocation(name), value);
+}
+
+void Shader::setBool(UniformId name, bool value) const
+{
+    GLState::instance().uniform1i(ID, getLocation(name), (int)value);
+}
+void Shader::setInt(UniformId name, int value) const
+{
+    GLState::instance().uniform1i(ID, getLocation(name), value);
+}
+void Shader::setFloat(UniformId name, float value) const
+{
+    GLState::instance().uniform1f(ID, getLocation(name), value);
+}
+void Shader::setVec2(UniformId name, const float * value) const
+{
+    GLState::instance().uniform2fv(ID, getLocation(name), value);
+}
+void Shader::setVec3(UniformId name, const float * value) const
+{
+    GLState::instance().uniform3fv(ID, getLocation(name), value);
+}
+void Shader::setVec4(UniformId name, const float * value, int count) const
+{
+    GLState::instance().uniform4fv(ID, getLocation(name), value, count);
+}
+void Shader::setIVec4(UniformId name, const int * value) const
+{
+    GLState::instance().uniform4iv(ID, getLocation(name), value);
+}
+void Shader::setMat3(UniformId name, const float * value) const
+{
+    GLState::instance().uniformMatrix3fv(ID, getLocation(name), value);
+}
+void Shader::setMat4f(UniformId name, const float * value) const
+{
+    GLState::instance().uniformMatrix4fv(ID, getLocation(name), value);
+}
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+}
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* geometryPath, const char* fragmentPath)
+    : vertexPath(vertexPath), geometryPath(geometryPath), fragmentPath(fragmentPath)
+{
+}
+
+Shader& ShaderVariants::get(const ShaderDefines &defines)
+{
+    std::string variantKey = key(defines);
+    auto it = variants.find(variantKey);
+    if (it != variants.end())
+        return *it->second;
+
+    Shader *variant = new Shader(vertexPath.c_str(), geometryPath.empty() ? nullptr : geometryPath.c_str(), fragmentPath.c_str(), defines);
+    variants[variantKey] = std::unique_ptr<Shader>(variant);
+    return *variant;
+}
+
+std::string ShaderVariants::key(const ShaderDefines &defines)
+{
+    std::string variantKey;
+    for (const auto &define : defines)
+        variantKey += define.first + "=" + define.second + ";";
+    return variantKey;
+}
@@ -2,24 +2,141 @@
 #define SHADER_H
 #include <glad/glad.h> // include glad to get the required OpenGL headers
 #include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "gpu_resource.h"
+
+// preprocessor defines injected right after the #version line of every stage, name -> value.
+// kept sorted so equal sets always produce the same variant key.
+typedef std::map<std::string, std::string> ShaderDefines;
+
+// FNV-1a hash of a uniform name, usable at compile time
+constexpr uint32_t uniformHash(const char* name, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ static_cast<unsigned char>(name[i])) * 16777619u;
+    return hash;
+}
+
+constexpr uint32_t uniformHash(const char* name)
+{
+    size_t length = 0;
+    while (name[length] != '\0')
+        length++;
+    return uniformHash(name, length);
+}
+
+// pre-hashed uniform name, build it with the _uniform literal ("view"_uniform) so the hash is folded at compile time
+struct UniformId {
+    uint32_t hash;
+    constexpr explicit UniformId(uint32_t hash) : hash(hash) {}
+};
+
+constexpr UniformId operator"" _uniform(const char* name, size_t length)
+{
+    return UniformId(uniformHash(name, length));
+}
+
+// matrix for the normals of a model matrix (inverse transpose of its upper 3x3), for the "normalMatrix" uniform of the
+// lighting shaders: computed once per object here rather than once per vertex in the shader
+inline glm::mat3 normalMatrix(const glm::mat4 &model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
 
 class Shader{
 public:
     // the program ID
     unsigned int ID;
-    // constructor reads and builds the shader
+    // constructor reads and builds the shader, reusing the program binary of a previous run when the driver supports it
     Shader(const char* vertexPath, const char* fragmentPath);
-    ~Shader(){glDeleteProgram(this->ID);}
+    Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines);
+    Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines());
+    // program without fragment stage whose outputs are captured by transform feedback, interleaved in the order of
+    // feedbackVaryings (geometryPath may be nullptr). Run it with GL_RASTERIZER_DISCARD enabled.
+    Shader(const char* vertexPath, const char* geometryPath, const std::vector<std::string> &feedbackVaryings, const ShaderDefines &defines = ShaderDefines());
+    // the program is owned by one shader, moving hands it over (the moved-from shader has ID 0), copying is not allowed
+    Shader(Shader &&other) noexcept;
+    Shader& operator=(Shader &&other) noexcept;
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
     // use/activate the shader
     void use();
+    // location of an active uniform from the table built at link time, -1 if the program has no such uniform. Names
+    // whose hash collides with another active uniform's can't be told apart by hash: they always give -1 here (the
+    // collision is reported at link time), the string overload still finds them by name.
+    int getLocation(UniformId name) const;
+    int getLocation(const std::string &name) const;
     // utility uniform functions
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
+    void setVec2(const std::string &name, const float * value) const;
+    void setVec3(const std::string &name, const float * value) const;
+    void setVec4(const std::string &name, const float * value, int count = 1) const;
+    void setIVec4(const std::string &name, const int * value) const;
+    void setMat3(const std::string &name, const float * value) const;
     void setMat4f(const std::string &name, const float * value) const;
+    // same setters taking pre-hashed names, no string handling and no driver query on the per-frame path
+    void setBool(UniformId name, bool value) const;
+    void setInt(UniformId name, int value) const;
+    void setFloat(UniformId name, float value) const;
+    void setVec2(UniformId name, const float * value) const;
+    void setVec3(UniformId name, const float * value) const;
+    void setVec4(UniformId name, const float * value, int count = 1) const;
+    void setIVec4(UniformId name, const int * value) const;
+    void setMat3(UniformId name, const float * value) const;
+    void setMat4f(UniformId name, const float * value) const;
+private:
+    // open addressing table of the active uniforms, keyed by name hash
+    struct UniformSlot {
+        uint32_t hash;
+        int location; // EMPTY_SLOT or COLLIDING_SLOT if not a location
+    };
+    static const int EMPTY_SLOT = -1;
+    static const int COLLIDING_SLOT = -2; // more than one active uniform has this hash
+    std::vector<UniformSlot> uniformSlots;
+    // name of the uniform in each slot, so lookups by string never take another uniform's location
+    std::vector<std::string> uniformNames;
+    // outputs captured by transform feedback, empty for regular programs
+    std::vector<std::string> feedbackVaryings;
+    // owns ID, deleted through the GpuResourcePool
+    GpuProgram program;
+
+    void build(const char* vertexPath, const char* geometryPath, const char* fragmentPath, const ShaderDefines &defines);
+    void compileAndLink(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode);
+    bool loadProgramBinary(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode);
+    void saveProgramBinary(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode);
+    std::string programCachePath(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode) const;
+    void reflectUniforms();
+    void insertUniform(const std::string &name, int location);
+    size_t findSlot(uint32_t hash) const;
+};
+
+// Compiled permutations of one set of shader sources. Each distinct define set is built on first request and kept,
+// so switching quality tiers or light counts at runtime never recompiles a variant that was built already.
+class ShaderVariants{
+public:
+    ShaderVariants(const char* vertexPath, const char* fragmentPath);
+    ShaderVariants(const char* vertexPath, const char* geometryPath, const char* fragmentPath);
+    // the variant specialized for defines, built if needed
+    Shader& get(const ShaderDefines &defines = ShaderDefines());
+    // number of variants built so far
+    size_t size() const { return variants.size(); }
+    // canonical "NAME=VALUE;..." key of a define set
+    static std::string key(const ShaderDefines &defines);
+private:
+    std::string vertexPath, geometryPath, fragmentPath;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> variants;
 };
-#endif 
\ No newline at end of file
+#endif
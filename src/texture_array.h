@@ -0,0 +1,195 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_resource.h"
+#include "shader.h"
+#include "texture_registry.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// The material textures of one or more models repacked into one GL_TEXTURE_2D_ARRAY per texture type, so every mesh
+// using them binds the same textures and only differs in the layers it samples. Those come as the "materialLayers"
+// ivec4 uniform (diffuse, specular, normal, height; -1 where the mesh has no texture of the type), e.g.
+//     texture(texture_diffuse_array, vec3(TexCoords, materialLayers.x))
+//
+// Every layer of an array has the size of its largest image and is RGBA8, smaller images are resampled bilinearly.
+// Layers are added first (addLayer hands out their indices right away), build() then decodes all images on the thread
+// pool and uploads them. A type with more layers than GL_MAX_ARRAY_TEXTURE_LAYERS fails the whole build, the meshes
+// holding those layers have to go back to their own textures (Model::useMeshTextures).
+class MaterialTextureArrays {
+public:
+    static const unsigned int TYPE_COUNT = 4;
+
+    // sRGB arrays, like the 2D textures of a model loaded with gamma
+    bool gamma;
+
+    explicit MaterialTextureArrays(bool gamma = false) : gamma(gamma) {}
+    MaterialTextureArrays(const MaterialTextureArrays&) = delete;
+    MaterialTextureArrays& operator=(const MaterialTextureArrays&) = delete;
+
+    // position of a Texture::type among the arrays and in materialLayers, -1 for types that aren't packed
+    static int typeIndex(const string &type)
+    {
+        for (unsigned int i = 0; i < TYPE_COUNT; i++)
+            if (type == TYPE_NAMES[i])
+                return (int)i;
+        return -1;
+    }
+
+    // layer of the image at path in the array of type, the same image always gets the same layer
+    int addLayer(unsigned int type, const string &path)
+    {
+        string key = TextureRegistry::canonicalPath(path);
+        auto it = layerIndices[type].find(key);
+        if (it != layerIndices[type].end())
+            return it->second;
+        int layer = (int)layerPaths[type].size();
+        layerIndices[type].emplace(key, layer);
+        layerPaths[type].push_back(path);
+        return layer;
+    }
+
+    size_t layerCount(unsigned int type) const { return layerPaths[type].size(); }
+
+    // decodes and uploads every layer added so far, again after adding more. Returns false, with no arrays built, if
+    // a type has more layers than the context supports: they can't all be sampled and no layer may be dropped silently.
+    bool build()
+    {
+        int maxLayers = 0, maxSize = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        for (unsigned int type = 0; type < TYPE_COUNT; type++)
+            arrays[type].reset();
+        for (unsigned int type = 0; type < TYPE_COUNT; type++)
+            if (layerPaths[type].size() > (size_t)maxLayers)
+            {
+                cout << "ERROR::TEXTURE_ARRAY:: " << layerPaths[type].size() << " " << TYPE_NAMES[type] << " layers, only "
+                     << maxLayers << " supported" << endl;
+                return false;
+            }
+
+        for (unsigned int type = 0; type < TYPE_COUNT; type++)
+        {
+            size_t count = layerPaths[type].size();
+            if (count == 0)
+                continue;
+
+            vector<Image> images(count);
+            ThreadPool::shared().parallelFor(count, 1, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    images[i].pixels = stbi_load(layerPaths[type][i].c_str(), &images[i].width, &images[i].height, nullptr, 4);
+            });
+            int width = 1, height = 1;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (!images[i].pixels)
+                    cout << "Texture failed to load at path: " << layerPaths[type][i] << endl;
+                else
+                {
+                    width = max(width, images[i].width);
+                    height = max(height, images[i].height);
+                }
+            }
+            width = min(width, maxSize);
+            height = min(height, maxSize);
+
+            // every layer brought to the array size, in parallel, then uploaded in one go
+            vector<unsigned char> layers(count * width * height * 4);
+            ThreadPool::shared().parallelFor(count, 1, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    unsigned char *layer = layers.data() + i * width * height * 4;
+                    if (images[i].pixels)
+                        resample(images[i].pixels, images[i].width, images[i].height, layer, width, height);
+                    else
+                        memset(layer, 128, (size_t)width * height * 4);
+                    stbi_image_free(images[i].pixels);
+                }
+            });
+
+            arrays[type] = GpuTexture::create(layers.size() * 4 / 3);
+            GLState::instance().bindTexture(GL_TEXTURE_2D_ARRAY, arrays[type].id());
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, (GLsizei)count, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, layers.data());
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            cout << "TEXTURE_ARRAY:: " << TYPE_NAMES[type] << " " << width << "x" << height << "x" << count << ", "
+                 << layers.size() * 4 / 3 / 1024 << " KiB with mipmaps" << endl;
+        }
+        return true;
+    }
+
+    // binds the arrays to units 0 to TYPE_COUNT - 1, points the shader's texture_*_array samplers at them and sets
+    // its "materialLayers"
+    void bind(Shader &shader, const glm::ivec4 &layers) const
+    {
+        static const UniformId samplerNames[TYPE_COUNT] = {"texture_diffuse_array"_uniform, "texture_specular_array"_uniform,
+                                                           "texture_normal_array"_uniform, "texture_height_array"_uniform};
+        GLState &gl = GLState::instance();
+        for (unsigned int type = 0; type < TYPE_COUNT; type++)
+        {
+            gl.uniform1i(shader.ID, shader.getLocation(samplerNames[type]), type);
+            gl.bindTextureUnit(type, GL_TEXTURE_2D_ARRAY, arrays[type].id());
+        }
+        shader.setIVec4("materialLayers"_uniform, &layers.x);
+    }
+
+private:
+    static constexpr const char *TYPE_NAMES[TYPE_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+
+    struct Image {
+        unsigned char *pixels = nullptr;
+        int width = 0, height = 0;
+    };
+
+    GpuTexture arrays[TYPE_COUNT];
+    vector<string> layerPaths[TYPE_COUNT];
+    unordered_map<string, int> layerIndices[TYPE_COUNT];
+
+    // bilinear resampling of an RGBA8 image, texel centers to texel centers
+    static void resample(const unsigned char *source, int sourceWidth, int sourceHeight, unsigned char *target, int width, int height)
+    {
+        if (sourceWidth == width && sourceHeight == height)
+        {
+            memcpy(target, source, (size_t)width * height * 4);
+            return;
+        }
+        for (int y = 0; y < height; y++)
+        {
+            float sy = glm::clamp((y + 0.5f) * sourceHeight / height - 0.5f, 0.0f, (float)(sourceHeight - 1));
+            int y0 = (int)sy, y1 = min(y0 + 1, sourceHeight - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < width; x++)
+            {
+                float sx = glm::clamp((x + 0.5f) * sourceWidth / width - 0.5f, 0.0f, (float)(sourceWidth - 1));
+                int x0 = (int)sx, x1 = min(x0 + 1, sourceWidth - 1);
+                float fx = sx - x0;
+                for (int c = 0; c < 4; c++)
+                {
+                    float top = source[(y0 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y0 * sourceWidth + x1) * 4 + c] * fx;
+                    float bottom = source[(y1 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y1 * sourceWidth + x1) * 4 + c] * fx;
+                    target[((size_t)y * width + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+    }
+};
+#endif
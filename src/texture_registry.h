@@ -0,0 +1,174 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+#include <stb/stb_image.h>
+
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "async_texture_loader.h"
+#include "gl_state.h"
+#include "gpu_resource.h"
+
+using namespace std;
+
+// Process-wide, reference-counted cache of 2D textures loaded from disk.
+// Textures are keyed by canonical path plus the options that change the uploaded texture (gamma, wrap mode), so every
+// image is decoded and uploaded once per process no matter how many models or demos ask for it.
+class TextureRegistry {
+public:
+    // lookup statistics
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    // when set, misses decode on the thread pool and stream in through AsyncTextureLoader (which then needs an update()
+    // per frame) instead of loading synchronously
+    bool asyncLoading = false;
+
+    static TextureRegistry& instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // returns the texture of the image at path, loading it on first use. Every acquire must be matched by a release.
+    unsigned int acquire(const string &path, bool gamma = false, GLint wrap = GL_REPEAT)
+    {
+        string key = makeKey(path, gamma, wrap);
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            hits++;
+            it->second.refCount++;
+            return it->second.id;
+        }
+
+        misses++;
+        // streamed textures don't know their size yet, they count with 0 bytes until their upload is done
+        size_t bytes = 0;
+        Entry entry;
+        entry.id = asyncLoading ? AsyncTextureLoader::instance().load(path, gamma, wrap) : loadFromDisk(path, gamma, wrap, &bytes);
+        entry.texture = GpuTexture(entry.id, bytes);
+        entry.refCount = 1;
+        unsigned int id = entry.id;
+        entries.emplace(key, std::move(entry));
+        keysById[id] = key;
+        return id;
+    }
+
+    // drops one reference to a texture returned by acquire, the texture is destroyed with its last reference (and
+    // deleted by the GpuResourcePool once the GPU is done with it).
+    void release(unsigned int id)
+    {
+        auto keyIt = keysById.find(id);
+        if (keyIt == keysById.end())
+            return;
+        auto it = entries.find(keyIt->second);
+        if (--it->second.refCount == 0)
+        {
+            AsyncTextureLoader::instance().cancel(id);
+            entries.erase(it);
+            keysById.erase(keyIt);
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+
+    void printStats() const
+    {
+        cout << "TEXTURE_REGISTRY:: " << entries.size() << " textures resident, " << hits << " hits, " << misses << " misses" << endl;
+    }
+
+    // decodes the image at path and uploads it as a mipmapped 2D texture, bytes gets its size with the mipmaps
+    static unsigned int loadFromDisk(const string &path, bool gamma, GLint wrap, size_t *bytes = nullptr)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+
+        int width, height, nrComponents;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+        if (data)
+        {
+            GLenum format = GL_RGB;
+            GLenum internalFormat = GL_RGB;
+            if (nrComponents == 1)
+                format = internalFormat = GL_RED;
+            else if (nrComponents == 3)
+            {
+                format = GL_RGB;
+                internalFormat = gamma ? GL_SRGB : GL_RGB;
+            }
+            else if (nrComponents == 4)
+            {
+                format = GL_RGBA;
+                internalFormat = gamma ? GL_SRGB_ALPHA : GL_RGBA;
+            }
+
+            GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            if (bytes)
+                *bytes = (size_t)width * height * nrComponents * 4 / 3;
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            stbi_image_free(data);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            stbi_image_free(data);
+        }
+
+        return textureID;
+    }
+
+    // absolute path with '.', '..' and symlinks resolved, so "a/../b.png" and "b.png" share one entry
+    static string canonicalPath(const string &path)
+    {
+#ifndef _WIN32
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return string(resolved);
+#else
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), _MAX_PATH))
+            return string(resolved);
+#endif
+        return path;
+    }
+
+private:
+    struct Entry {
+        unsigned int id;
+        GpuTexture texture; // owns id
+        unsigned int refCount;
+    };
+    unordered_map<string, Entry> entries;
+    unordered_map<unsigned int, string> keysById;
+
+    TextureRegistry()
+    {
+        // streamed textures get their size once the loader has uploaded them
+        AsyncTextureLoader::instance().onUploaded = [this](unsigned int id, size_t bytes)
+        {
+            auto keyIt = keysById.find(id);
+            if (keyIt != keysById.end())
+                entries.find(keyIt->second)->second.texture.setBytes(bytes);
+        };
+    }
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    static string makeKey(const string &path, bool gamma, GLint wrap)
+    {
+        return canonicalPath(path) + (gamma ? "|srgb|" : "|linear|") + to_string(wrap);
+    }
+};
+#endif
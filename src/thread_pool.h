@@ -0,0 +1,131 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of worker threads fed from a single job queue. Used for the CPU side of asset loading
+// (mesh conversion, image decoding, ...) and per-frame CPU work such as culling; nothing submitted here may touch the
+// OpenGL context.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = max(1u, thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (thread &worker : workers)
+            worker.join();
+    }
+
+    // process-wide pool sized to the number of hardware threads
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    // queues job to run on one of the workers
+    void submit(function<void()> job)
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            jobs.push_back(std::move(job));
+        }
+        queueCondition.notify_one();
+    }
+
+    // calls body(begin, end) over [0, count) in chunks of at most grain items and returns once every chunk is done.
+    // The calling thread works on chunks too, so this is safe to call from inside a job.
+    void parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)> &body)
+    {
+        if (count == 0)
+            return;
+        grain = max<size_t>(grain, 1);
+        size_t chunks = (count + grain - 1) / grain;
+        if (chunks == 1 || workers.empty())
+        {
+            body(0, count);
+            return;
+        }
+
+        struct ForState {
+            atomic<size_t> next{0};
+            atomic<size_t> done{0};
+            mutex doneMutex;
+            condition_variable doneCondition;
+        };
+        shared_ptr<ForState> state = make_shared<ForState>();
+        const function<void(size_t, size_t)> *bodyPtr = &body;
+        auto work = [state, bodyPtr, count, grain, chunks]()
+        {
+            size_t chunk;
+            while ((chunk = state->next++) < chunks)
+            {
+                (*bodyPtr)(chunk * grain, min(count, (chunk + 1) * grain));
+                if (++state->done == chunks)
+                {
+                    lock_guard<mutex> lock(state->doneMutex);
+                    state->doneCondition.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = min<size_t>(workers.size(), chunks - 1);
+        for (size_t i = 0; i < helpers; i++)
+            submit(work);
+        work();
+
+        unique_lock<mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&]() { return state->done == chunks; });
+    }
+
+private:
+    vector<thread> workers;
+    deque<function<void()>> jobs;
+    mutex queueMutex;
+    condition_variable queueCondition;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+#endif
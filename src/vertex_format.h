@@ -0,0 +1,415 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+#define MAX_BONE_INFLUENCE 4
+
+// the full vertex every import produces and every CPU-side pass (welding, simplification, caching) works on; what
+// reaches the GPU is only the part of it the mesh's VertexFormat keeps
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+	//bone indexes which will influence this vertex
+	int m_BoneIDs[MAX_BONE_INFLUENCE];
+	//weights from each bone
+	float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// GPU vertex layouts, each one extending the previous; attribute locations are the same in all of them
+enum class VertexFormat : uint32_t {
+    Basic = 0,            // position, normal, uv (32 bytes)
+    Tangent = 1,          // + tangent and bitangent for normal mapping (56 bytes)
+    Skinned = 2,          // + bone ids and weights (88 bytes)
+    Quantized = 3,        // Basic with unorm16 positions, 10_10_10_2 snorm normals and half float uvs (16 bytes)
+    QuantizedTangent = 4  // Tangent quantized the same way (24 bytes)
+};
+
+// The quantized formats store positions as unorm16 inside the mesh's bounding box; shaders decode them with
+// position = positionOffset + aPos * positionScale (Mesh::bindMaterial sets both, identity for the float formats).
+// Normals, tangents and uvs need no decoding, the attribute pointers normalize and widen them.
+struct PositionDecode {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+
+    static PositionDecode fromBounds(const glm::vec3 &low, const glm::vec3 &high)
+    {
+        PositionDecode decode;
+        decode.offset = low;
+        decode.scale = glm::max(high - low, glm::vec3(1e-20f));
+        return decode;
+    }
+};
+
+// largest difference between the vertices and what a format gives back of them
+struct QuantizationError {
+    float position = 0.0f;  // object space units
+    float normal = 0.0f;    // degrees
+};
+
+struct BasicVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+
+    static const VertexFormat format = VertexFormat::Basic;
+
+    static BasicVertex pack(const Vertex &vertex, const PositionDecode&)
+    {
+        return BasicVertex{vertex.Position, vertex.Normal, vertex.TexCoords};
+    }
+    static Vertex unpack(const BasicVertex &packed, const PositionDecode&)
+    {
+        Vertex vertex = {};
+        vertex.Position = packed.Position;
+        vertex.Normal = packed.Normal;
+        vertex.TexCoords = packed.TexCoords;
+        return vertex;
+    }
+
+    // locations 0 to 2
+    static void setupAttributes()
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BasicVertex), (void*)offsetof(BasicVertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BasicVertex), (void*)offsetof(BasicVertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(BasicVertex), (void*)offsetof(BasicVertex, TexCoords));
+    }
+};
+
+struct TangentVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+
+    static const VertexFormat format = VertexFormat::Tangent;
+
+    static TangentVertex pack(const Vertex &vertex, const PositionDecode&)
+    {
+        return TangentVertex{vertex.Position, vertex.Normal, vertex.TexCoords, vertex.Tangent, vertex.Bitangent};
+    }
+    static Vertex unpack(const TangentVertex &packed, const PositionDecode&)
+    {
+        Vertex vertex = {};
+        vertex.Position = packed.Position;
+        vertex.Normal = packed.Normal;
+        vertex.TexCoords = packed.TexCoords;
+        vertex.Tangent = packed.Tangent;
+        vertex.Bitangent = packed.Bitangent;
+        return vertex;
+    }
+
+    // locations 0 to 4
+    static void setupAttributes()
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TangentVertex), (void*)offsetof(TangentVertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TangentVertex), (void*)offsetof(TangentVertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TangentVertex), (void*)offsetof(TangentVertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TangentVertex), (void*)offsetof(TangentVertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(TangentVertex), (void*)offsetof(TangentVertex, Bitangent));
+    }
+};
+
+// the full Vertex as is
+struct SkinnedVertex : Vertex {
+    static const VertexFormat format = VertexFormat::Skinned;
+
+    static SkinnedVertex pack(const Vertex &vertex, const PositionDecode&)
+    {
+        SkinnedVertex packed;
+        static_cast<Vertex&>(packed) = vertex;
+        return packed;
+    }
+    static Vertex unpack(const SkinnedVertex &packed, const PositionDecode&) { return packed; }
+
+    // locations 0 to 6
+    static void setupAttributes()
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+    }
+};
+
+// helpers of the quantized layouts
+struct VertexQuantization {
+    static void position(const glm::vec3 &value, const PositionDecode &decode, uint16_t out[4])
+    {
+        glm::vec3 unit = glm::clamp((value - decode.offset) / decode.scale, 0.0f, 1.0f);
+        for (int c = 0; c < 3; c++)
+            out[c] = (uint16_t)lround(unit[c] * 65535.0f);
+        out[3] = 0;
+    }
+    static glm::vec3 position(const uint16_t in[4], const PositionDecode &decode)
+    {
+        return decode.offset + glm::vec3(in[0], in[1], in[2]) / 65535.0f * decode.scale;
+    }
+
+    // GL_INT_2_10_10_10_REV: x in the low bits, w (unused) in the top 2
+    static uint32_t direction(const glm::vec3 &value)
+    {
+        uint32_t packed = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            int component = (int)lround(glm::clamp(value[c], -1.0f, 1.0f) * 511.0f);
+            packed |= ((uint32_t)component & 0x3ffu) << (c * 10);
+        }
+        return packed;
+    }
+    static glm::vec3 direction(uint32_t packed)
+    {
+        glm::vec3 value;
+        for (int c = 0; c < 3; c++)
+        {
+            int component = (int)((packed >> (c * 10)) & 0x3ffu);
+            if (component >= 512)
+                component -= 1024;
+            value[c] = max(component / 511.0f, -1.0f);
+        }
+        return value;
+    }
+
+    static void positionAttribute(GLsizei stride, size_t offset)
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offset);
+    }
+    static void directionAttribute(GLuint location, GLsizei stride, size_t offset)
+    {
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset);
+    }
+    static void texCoordAttribute(GLsizei stride, size_t offset)
+    {
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+};
+
+struct QuantizedVertex {
+    uint16_t Position[4];
+    uint32_t Normal;
+    uint32_t TexCoords;  // two halves
+
+    static const VertexFormat format = VertexFormat::Quantized;
+
+    static QuantizedVertex pack(const Vertex &vertex, const PositionDecode &decode)
+    {
+        QuantizedVertex packed;
+        VertexQuantization::position(vertex.Position, decode, packed.Position);
+        packed.Normal = VertexQuantization::direction(vertex.Normal);
+        packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+        return packed;
+    }
+    static Vertex unpack(const QuantizedVertex &packed, const PositionDecode &decode)
+    {
+        Vertex vertex = {};
+        vertex.Position = VertexQuantization::position(packed.Position, decode);
+        vertex.Normal = VertexQuantization::direction(packed.Normal);
+        vertex.TexCoords = glm::unpackHalf2x16(packed.TexCoords);
+        return vertex;
+    }
+
+    // locations 0 to 2
+    static void setupAttributes()
+    {
+        VertexQuantization::positionAttribute(sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+        VertexQuantization::directionAttribute(1, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+        VertexQuantization::texCoordAttribute(sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoords));
+    }
+};
+
+struct QuantizedTangentVertex {
+    uint16_t Position[4];
+    uint32_t Normal;
+    uint32_t TexCoords;
+    uint32_t Tangent;
+    uint32_t Bitangent;
+
+    static const VertexFormat format = VertexFormat::QuantizedTangent;
+
+    static QuantizedTangentVertex pack(const Vertex &vertex, const PositionDecode &decode)
+    {
+        QuantizedTangentVertex packed;
+        VertexQuantization::position(vertex.Position, decode, packed.Position);
+        packed.Normal = VertexQuantization::direction(vertex.Normal);
+        packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+        // the tangent frame isn't always unit length out of the importer, only its direction matters
+        packed.Tangent = VertexQuantization::direction(safeNormalize(vertex.Tangent));
+        packed.Bitangent = VertexQuantization::direction(safeNormalize(vertex.Bitangent));
+        return packed;
+    }
+    static Vertex unpack(const QuantizedTangentVertex &packed, const PositionDecode &decode)
+    {
+        Vertex vertex = {};
+        vertex.Position = VertexQuantization::position(packed.Position, decode);
+        vertex.Normal = VertexQuantization::direction(packed.Normal);
+        vertex.TexCoords = glm::unpackHalf2x16(packed.TexCoords);
+        vertex.Tangent = VertexQuantization::direction(packed.Tangent);
+        vertex.Bitangent = VertexQuantization::direction(packed.Bitangent);
+        return vertex;
+    }
+
+    // locations 0 to 4
+    static void setupAttributes()
+    {
+        VertexQuantization::positionAttribute(sizeof(QuantizedTangentVertex), offsetof(QuantizedTangentVertex, Position));
+        VertexQuantization::directionAttribute(1, sizeof(QuantizedTangentVertex), offsetof(QuantizedTangentVertex, Normal));
+        VertexQuantization::texCoordAttribute(sizeof(QuantizedTangentVertex), offsetof(QuantizedTangentVertex, TexCoords));
+        VertexQuantization::directionAttribute(3, sizeof(QuantizedTangentVertex), offsetof(QuantizedTangentVertex, Tangent));
+        VertexQuantization::directionAttribute(4, sizeof(QuantizedTangentVertex), offsetof(QuantizedTangentVertex, Bitangent));
+    }
+
+private:
+    static glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+};
+
+// calls visit(Layout()) with the layout struct of format, so code templated on the layout can be picked at run time
+template<typename Visit>
+inline void visitVertexFormat(VertexFormat format, Visit visit)
+{
+    switch (format)
+    {
+    case VertexFormat::Basic:   visit(BasicVertex()); break;
+    case VertexFormat::Tangent: visit(TangentVertex()); break;
+    case VertexFormat::Skinned: visit(SkinnedVertex()); break;
+    case VertexFormat::Quantized: visit(QuantizedVertex()); break;
+    case VertexFormat::QuantizedTangent: visit(QuantizedTangentVertex()); break;
+    }
+}
+
+// bytes per vertex of format on the GPU
+inline size_t vertexFormatSize(VertexFormat format)
+{
+    size_t size = 0;
+    visitVertexFormat(format, [&](auto layout) { size = sizeof(layout); });
+    return size;
+}
+
+// whether format needs a PositionDecode
+inline bool vertexFormatQuantized(VertexFormat format)
+{
+    return format == VertexFormat::Quantized || format == VertexFormat::QuantizedTangent;
+}
+
+// the quantized counterpart of a float format, Skinned stays as it is
+inline VertexFormat quantizedVertexFormat(VertexFormat format)
+{
+    if (format == VertexFormat::Basic)
+        return VertexFormat::Quantized;
+    if (format == VertexFormat::Tangent)
+        return VertexFormat::QuantizedTangent;
+    return format;
+}
+
+// the count vertices packed into format, ready for glBufferData
+inline vector<unsigned char> packVertices(VertexFormat format, const Vertex *vertices, size_t count,
+                                          const PositionDecode &decode = PositionDecode())
+{
+    vector<unsigned char> packed;
+    visitVertexFormat(format, [&](auto layout)
+    {
+        typedef decltype(layout) Layout;
+        packed.resize(count * sizeof(Layout));
+        for (size_t i = 0; i < count; i++)
+        {
+            Layout vertex = Layout::pack(vertices[i], decode);
+            memcpy(packed.data() + i * sizeof(Layout), &vertex, sizeof(Layout));
+        }
+    });
+    return packed;
+}
+
+// the count vertices at packed, in format, widened back to full vertices: what the format dropped (the tangent frame
+// of Basic, the bone data of all but Skinned) comes back zeroed, quantized attributes with the quantization error
+inline vector<Vertex> unpackVertices(VertexFormat format, const void *packed, size_t count,
+                                     const PositionDecode &decode = PositionDecode())
+{
+    vector<Vertex> vertices(count);
+    visitVertexFormat(format, [&](auto layout)
+    {
+        typedef decltype(layout) Layout;
+        const unsigned char *bytes = static_cast<const unsigned char*>(packed);
+        for (size_t i = 0; i < count; i++)
+        {
+            Layout vertex;
+            memcpy(&vertex, bytes + i * sizeof(Layout), sizeof(Layout));
+            vertices[i] = Layout::unpack(vertex, decode);
+        }
+    });
+    return vertices;
+}
+
+// packs and unpacks every vertex to find how far the format moves positions and turns normals
+inline QuantizationError measureQuantizationError(VertexFormat format, const Vertex *vertices, size_t count,
+                                                  const PositionDecode &decode)
+{
+    QuantizationError error;
+    visitVertexFormat(format, [&](auto layout)
+    {
+        typedef decltype(layout) Layout;
+        for (size_t i = 0; i < count; i++)
+        {
+            Vertex restored = Layout::unpack(Layout::pack(vertices[i], decode), decode);
+            glm::vec3 delta = glm::abs(restored.Position - vertices[i].Position);
+            error.position = max(error.position, max(max(delta.x, delta.y), delta.z));
+            float length = glm::length(vertices[i].Normal) * glm::length(restored.Normal);
+            if (length > 0.0f)
+            {
+                float cosine = glm::clamp(glm::dot(vertices[i].Normal, restored.Normal) / length, -1.0f, 1.0f);
+                error.normal = max(error.normal, glm::degrees(acos(cosine)));
+            }
+        }
+    });
+    return error;
+}
+
+// attribute pointers of format for the bound VAO and GL_ARRAY_BUFFER
+inline void setupVertexAttributes(VertexFormat format)
+{
+    visitVertexFormat(format, [](auto layout) { decltype(layout)::setupAttributes(); });
+}
+#endif